@@ -0,0 +1,93 @@
+//===--------------------------------------------------------------------------------------------===
+// api.h - HeadTrack's interface for other X-Plane plugins
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+// Plugins that only need the latest poses can read the array datarefs below, with a single
+// XPLMGetDatavf() call each. Plugins that want to run right after HeadTrack moves the view, every
+// frame, can register a listener with htk_api_add_listener().
+//
+// Poses are x, y, z (cm), yaw, pitch, roll (degrees). Raw and filtered poses are as they come
+// from the tracker; output poses are what HeadTrack adds to the default pilot's head position.
+#pragma once
+#include <XPLMPlugin.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTK_PLUGIN_SIGNATURE "com.amyinorbit.htrack"
+
+/// Bumped whenever htk_api_frame_t or htk_api_listener_t change.
+#define HTK_API_VERSION (1)
+
+// MARK: - Datarefs
+
+#define HTK_DR_POSE_RAW "amyinorbit/htrack/pose/raw"            // float[6], read only
+#define HTK_DR_POSE_FILTERED "amyinorbit/htrack/pose/filtered"  // float[6], read only
+#define HTK_DR_POSE_OUTPUT "amyinorbit/htrack/pose/output"      // float[6], read only
+
+/// float[2], read only: how old the latest tracker sample was at the last frame (seconds), and
+/// the tracker's packet rate (Hz).
+#define HTK_DR_POSE_TIMING "amyinorbit/htrack/pose/timing"
+
+/// int, read only: HTK_API_* flags for the last frame.
+#define HTK_DR_STATE "amyinorbit/htrack/state"
+
+// MARK: - Per-frame listeners
+
+enum {
+    HTK_API_ENABLED = 1 << 0,       // head tracking is turned on
+    HTK_API_ACTIVE = 1 << 1,        // ...and the view is the 3D cockpit, so [output] is live
+    HTK_API_LOCAL_INPUT = 1 << 2,   // poses come from the shared-memory input, not UDP
+};
+
+typedef struct {
+    uint32_t version;       // HTK_API_VERSION of the HeadTrack build
+    uint32_t flags;
+    uint64_t frame;         // frames HeadTrack has run
+    double sample_age;      // seconds between the latest tracker sample and this frame
+    double raw[6];
+    double filtered[6];
+    double output[6];
+} htk_api_frame_t;
+
+/// Called on the sim thread, every frame, once HeadTrack has written the view datarefs. [frame]
+/// is only valid during the call.
+typedef void (*htk_api_callback_t)(const htk_api_frame_t *frame, void *refcon);
+
+typedef struct {
+    uint32_t version;       // set to HTK_API_VERSION
+    htk_api_callback_t callback;
+    void *refcon;
+} htk_api_listener_t;
+
+/// Message sent to HeadTrack to add or remove a listener. The parameter is a pointer to an
+/// htk_api_listener_t, which HeadTrack copies. Listeners are told apart by callback and refcon.
+#define HTK_MSG_ADD_LISTENER (0x48540001)
+#define HTK_MSG_REMOVE_LISTENER (0x48540002)
+
+/// Registers [listener] with HeadTrack. Returns false if HeadTrack isn't installed. Call from
+/// XPluginEnable(), and remove the listener in XPluginDisable(): HeadTrack can't tell when
+/// another plugin goes away.
+static inline bool htk_api_add_listener(const htk_api_listener_t *listener) {
+    XPLMPluginID htrack = XPLMFindPluginBySignature(HTK_PLUGIN_SIGNATURE);
+    if(htrack == XPLM_NO_PLUGIN_ID) return false;
+    XPLMSendMessageToPlugin(htrack, HTK_MSG_ADD_LISTENER, (void *)listener);
+    return true;
+}
+
+static inline void htk_api_remove_listener(const htk_api_listener_t *listener) {
+    XPLMPluginID htrack = XPLMFindPluginBySignature(HTK_PLUGIN_SIGNATURE);
+    if(htrack == XPLM_NO_PLUGIN_ID) return;
+    XPLMSendMessageToPlugin(htrack, HTK_MSG_REMOVE_LISTENER, (void *)listener);
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,275 @@
+//===--------------------------------------------------------------------------------------------===
+// shm.h - shared-memory channels to and from processes on the same machine
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+// This header has no dependencies beyond the C standard library and POSIX, so trackers can copy
+// it into their own tree. It builds as C11 and C++11 with GCC or Clang. In strict modes
+// (-std=c11 rather than gnu11), it must be included before any system header so that it can
+// ask for the POSIX functions it needs, or the program must be built with -D_GNU_SOURCE on Linux
+// and -D_POSIX_C_SOURCE=200809L elsewhere.
+//
+// There are two segments, both created and removed by HeadTrack:
+//
+// - the input, when "Shared memory input" is turned on. A tracker opens it with
+//   htk_shm_input_open(), calls htk_shm_input_write() for every pose, and reopens it whenever
+//   htk_shm_input_is_closed() says HeadTrack went away.
+// - the output, while the plugin is enabled. HeadTrack publishes every frame to it, and any
+//   number of processes can map it with htk_shm_output_open() and poll it with
+//   htk_shm_output_read(), at whatever rate suits them.
+#pragma once
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // syscall(), for the futex
+#elif !defined(__linux__) && !defined(__APPLE__) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#else
+#include <semaphore.h>
+#endif
+
+#if !defined(CLOCK_MONOTONIC)
+#error "htrack/shm.h needs POSIX.1-2008: include it first, or see the note at the top"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// MARK: - Input
+
+#define HTK_SHM_INPUT_NAME "/htrack-input"
+
+/// Named semaphore HeadTrack sleeps on where there are no futexes (everywhere but Linux).
+#define HTK_SHM_INPUT_WAKE_NAME "/htrack-input-wake"
+#define HTK_SHM_INPUT_MAGIC (0x494b5448u) // "HTKI"
+#define HTK_SHM_INPUT_VERSION (1)
+
+/// Number of poses the ring holds. A reader that falls further behind than this loses the oldest.
+#define HTK_SHM_INPUT_SLOTS (16)
+
+/// One pose, guarded by its own sequence number: odd while the writer is filling it in.
+typedef struct {
+    uint32_t seq;
+    uint32_t reserved;
+    uint64_t time;      // writer's CLOCK_MONOTONIC, in microseconds
+    double pose[6];     // x, y, z (cm), yaw, pitch, roll (degrees), as in OpenTrack packets
+} htk_shm_slot_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t is_closed;     // set by HeadTrack before it removes the segment
+    uint32_t count;         // poses written so far; slot (count % slot_count) is the next one
+    uint32_t is_waiting;    // set by HeadTrack while it sleeps on [count], or on the semaphore
+    uint64_t reserved[5];
+    htk_shm_slot_t slots[HTK_SHM_INPUT_SLOTS];
+} htk_shm_input_t;
+
+/// Sequence number of the slot holding pose number [index], once it's written. Each slot goes
+/// through 2, 4, 6... as it is reused, so a reader can tell which pose it holds.
+static inline uint32_t htk_shm_slot_seq(uint32_t index) {
+    return 2 * (index / HTK_SHM_INPUT_SLOTS + 1);
+}
+
+// Tracker side:
+
+#if !defined(__linux__)
+/// The writer's handle on the wake-up semaphore. It is only valid in this process, so it can't
+/// live in the segment; it is reopened along with it.
+static inline sem_t **htk_shm_input_wake_(void) {
+    static sem_t *wake = SEM_FAILED;
+    return &wake;
+}
+#endif
+
+/// Maps the segment created by HeadTrack. Returns NULL if HeadTrack isn't listening, or speaks a
+/// different version of the protocol.
+static inline htk_shm_input_t *htk_shm_input_open(void) {
+    int fd = shm_open(HTK_SHM_INPUT_NAME, O_RDWR, 0);
+    if(fd < 0) return NULL;
+    void *mem = mmap(NULL, sizeof(htk_shm_input_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED) return NULL;
+
+    htk_shm_input_t *shm = (htk_shm_input_t *)mem;
+    if(__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != HTK_SHM_INPUT_MAGIC
+       || shm->version != HTK_SHM_INPUT_VERSION
+       || shm->slot_count != HTK_SHM_INPUT_SLOTS) {
+        munmap(mem, sizeof(htk_shm_input_t));
+        return NULL;
+    }
+#if !defined(__linux__)
+    // Without it, HeadTrack still picks poses up when its wait times out, only later.
+    sem_t **wake = htk_shm_input_wake_();
+    if(*wake != SEM_FAILED) sem_close(*wake);
+    *wake = sem_open(HTK_SHM_INPUT_WAKE_NAME, 0);
+#endif
+    return shm;
+}
+
+static inline void htk_shm_input_close(htk_shm_input_t *shm) {
+#if !defined(__linux__)
+    sem_t **wake = htk_shm_input_wake_();
+    if(*wake != SEM_FAILED) sem_close(*wake);
+    *wake = SEM_FAILED;
+#endif
+    if(shm) munmap((void *)shm, sizeof(htk_shm_input_t));
+}
+
+/// True once HeadTrack has stopped reading: close the segment and try to open it again later.
+static inline bool htk_shm_input_is_closed(const htk_shm_input_t *shm) {
+    return __atomic_load_n(&shm->is_closed, __ATOMIC_RELAXED) != 0;
+}
+
+/// Publishes [pose]. Never blocks; the only system call is a wake-up, when HeadTrack is asleep
+/// waiting for a pose. Only one thread, in one process, may write to a segment.
+static inline void htk_shm_input_write(htk_shm_input_t *shm, const double pose[6]) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t time = (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+
+    uint32_t count = __atomic_load_n(&shm->count, __ATOMIC_RELAXED);
+    htk_shm_slot_t *slot = &shm->slots[count % HTK_SHM_INPUT_SLOTS];
+    uint32_t seq = htk_shm_slot_seq(count);
+
+    __atomic_store_n(&slot->seq, seq - 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->time, time, __ATOMIC_RELAXED);
+    for(int i = 0; i < 6; ++i) {
+        double value = pose[i];
+        __atomic_store(&slot->pose[i], &value, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+    __atomic_store_n(&shm->count, count + 1, __ATOMIC_SEQ_CST);
+
+    if(!__atomic_load_n(&shm->is_waiting, __ATOMIC_SEQ_CST)) return;
+#if defined(__linux__)
+    syscall(SYS_futex, &shm->count, FUTEX_WAKE, 1, NULL, NULL, 0);
+#else
+    sem_t *wake = *htk_shm_input_wake_();
+    if(wake != SEM_FAILED) sem_post(wake);
+#endif
+}
+
+// HeadTrack side:
+
+/// Copies the pose written as number [index] into [time] and [pose]. Returns false if the writer
+/// has overwritten it, or is in the middle of doing so.
+static inline bool htk_shm_input_read(const htk_shm_input_t *shm, uint32_t index,
+                                      uint64_t *time, double pose[6]) {
+    const htk_shm_slot_t *slot = &shm->slots[index % HTK_SHM_INPUT_SLOTS];
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if(seq != htk_shm_slot_seq(index)) return false;
+
+    *time = __atomic_load_n(&slot->time, __ATOMIC_RELAXED);
+    for(int i = 0; i < 6; ++i) {
+        __atomic_load(&slot->pose[i], &pose[i], __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq;
+}
+
+// MARK: - Output
+
+#define HTK_SHM_OUTPUT_NAME "/htrack-output"
+#define HTK_SHM_OUTPUT_MAGIC (0x4f4b5448u) // "HTKO"
+#define HTK_SHM_OUTPUT_VERSION (1)
+
+/// Flags describing what HeadTrack was doing when it published a frame.
+enum {
+    HTK_SHM_ENABLED = 1 << 0,       // head tracking is turned on
+    HTK_SHM_ACTIVE = 1 << 1,        // ...and the view is the 3D cockpit, so [output] is live
+    HTK_SHM_LOCAL_INPUT = 1 << 2,   // poses come from the shared-memory input, not UDP
+};
+
+/// Times are CLOCK_MONOTONIC, in microseconds. Poses are x, y, z (cm), yaw, pitch, roll
+/// (degrees), like the input.
+typedef struct {
+    uint64_t frame;         // frames published so far
+    uint64_t time;          // when this frame was published
+    uint64_t input_time;    // when the tracker sample in [input] was received
+    uint32_t flags;
+    uint32_t reserved;
+    double input[6];        // latest tracker pose, after input smoothing
+    double output[6];       // pose applied to the view, relative to the default pilot's head
+    double viewpoint[3];    // default pilot's head position in the aircraft (metres)
+} htk_shm_frame_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;           // odd while HeadTrack is writing [frame]
+    uint32_t is_closed;     // set by HeadTrack before it removes the segment
+    uint64_t reserved[6];
+    htk_shm_frame_t frame;
+} htk_shm_output_t;
+
+/// Maps the segment read-only. Returns NULL if HeadTrack isn't running, or speaks a different
+/// version of the protocol.
+static inline const htk_shm_output_t *htk_shm_output_open(void) {
+    int fd = shm_open(HTK_SHM_OUTPUT_NAME, O_RDONLY, 0);
+    if(fd < 0) return NULL;
+    void *mem = mmap(NULL, sizeof(htk_shm_output_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED) return NULL;
+
+    const htk_shm_output_t *shm = (const htk_shm_output_t *)mem;
+    if(__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != HTK_SHM_OUTPUT_MAGIC
+       || shm->version != HTK_SHM_OUTPUT_VERSION) {
+        munmap(mem, sizeof(htk_shm_output_t));
+        return NULL;
+    }
+    return shm;
+}
+
+static inline void htk_shm_output_close(const htk_shm_output_t *shm) {
+    if(shm) munmap((void *)shm, sizeof(htk_shm_output_t));
+}
+
+/// True once HeadTrack has stopped publishing: close the segment and try to open it again later.
+static inline bool htk_shm_output_is_closed(const htk_shm_output_t *shm) {
+    return __atomic_load_n(&shm->is_closed, __ATOMIC_RELAXED) != 0;
+}
+
+/// Copies the latest frame into [out]. Never blocks HeadTrack: if it is publishing right now,
+/// the copy is simply retried. Compare [out->frame] with the last one read to spot new frames.
+static inline void htk_shm_output_read(const htk_shm_output_t *shm, htk_shm_frame_t *out) {
+    const htk_shm_frame_t *in = &shm->frame;
+    for(;;) {
+        uint32_t seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if(seq & 1) continue;
+
+        out->frame = __atomic_load_n(&in->frame, __ATOMIC_RELAXED);
+        out->time = __atomic_load_n(&in->time, __ATOMIC_RELAXED);
+        out->input_time = __atomic_load_n(&in->input_time, __ATOMIC_RELAXED);
+        out->flags = __atomic_load_n(&in->flags, __ATOMIC_RELAXED);
+        out->reserved = 0;
+        for(int i = 0; i < 6; ++i) {
+            __atomic_load(&in->input[i], &out->input[i], __ATOMIC_RELAXED);
+            __atomic_load(&in->output[i], &out->output[i], __ATOMIC_RELAXED);
+        }
+        for(int i = 0; i < 3; ++i) {
+            __atomic_load(&in->viewpoint[i], &out->viewpoint[i], __ATOMIC_RELAXED);
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq) return;
+    }
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
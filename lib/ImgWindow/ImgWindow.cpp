@@ -37,6 +37,9 @@
 #include <XPLMDataAccess.h>
 #include <XPLMDisplay.h>
 #include <XPLMGraphics.h>
+#include <XPLMUtilities.h>
+
+#include <cstring>
 
 // size of "frame" around a resizable window, by which its size can be changed
 constexpr int WND_RESIZE_LEFT_WIDTH     = 15;
@@ -51,6 +54,7 @@ static XPLMDataRef		gProjectionMatrixRef	= nullptr;
 static XPLMDataRef		gFrameRatePeriodRef     = nullptr;
 
 std::shared_ptr<ImgFontAtlas> ImgWindow::sFontAtlas;
+ImgWindow::Renderer ImgWindow::sRenderer = ImgWindow::Renderer::Buffered;
 
 ImgWindow::ImgWindow(
 	int left,
@@ -121,9 +125,10 @@ ImgWindow::ImgWindow(
     } else {
         if (!iFontAtlas || iFontAtlas->TexID == nullptr) {
             // fallback binding if an atlas wasn't explicitly set.
+            // RGBA rather than alpha-only, so both renderers can simply modulate by the texture.
             unsigned char *pixels;
             int width, height;
-            io.Fonts->GetTexDataAsAlpha8(&pixels, &width, &height);
+            io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
 
             // slightly stupid dance around the texture number due to XPLM not using GLint here.
             int texNum = 0;
@@ -137,11 +142,11 @@ ImgWindow::ImgWindow(
             glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
             glTexImage2D(GL_TEXTURE_2D,
                          0,
-                         GL_ALPHA,
+                         GL_RGBA,
                          width,
                          height,
                          0,
-                         GL_ALPHA,
+                         GL_RGBA,
                          GL_UNSIGNED_BYTE,
                          pixels);
             io.Fonts->SetTexID((void *)((intptr_t)(mFontTexture)));
@@ -178,6 +183,14 @@ ImgWindow::ImgWindow(
 ImgWindow::~ImgWindow()
 {
 	ImGui::SetCurrentContext(mImGuiContext);
+	for (auto *list : mDrawLists) {
+		IM_DELETE(list);
+	}
+#if IMGWINDOW_HAS_GLEW
+	if (mProgram) glDeleteProgram(mProgram);
+	if (mVertexBuffer) glDeleteBuffers(1, &mVertexBuffer);
+	if (mIndexBuffer) glDeleteBuffers(1, &mIndexBuffer);
+#endif
 	if (!mFontAtlas) {
 	    // if we didn't have an explicit font atlas, destroy the texture.
         glDeleteTextures(1, &mFontTexture);
@@ -209,6 +222,12 @@ ImgWindow::SetWindowResizingLimits (int minW, int minH, int maxW, int maxH)
     XPLMSetWindowResizingLimits(mWindowID, minW, minH, maxW, maxH);
 }
 
+void
+ImgWindow::SetRefreshRate(float hz)
+{
+    mRefreshPeriod = hz > 0.f ? 1.f / hz : 0.f;
+}
+
 void
 ImgWindow::updateMatrices()
 {
@@ -259,6 +278,14 @@ ImgWindow::RenderImGui(ImDrawData *draw_data)
 
     updateMatrices();
 
+    if (sRenderer == Renderer::Buffered && RenderImGuiBuffered(draw_data))
+        return;
+    RenderImGuiLegacy(draw_data);
+}
+
+void
+ImgWindow::RenderImGuiLegacy(ImDrawData *draw_data)
+{
 	// We are using the OpenGL fixed pipeline because messing with the
 	// shader-state in X-Plane is not very well documented, but using the fixed
 	// function pipeline is.
@@ -322,6 +349,299 @@ ImgWindow::RenderImGui(ImDrawData *draw_data)
 	glPopClientAttrib();
 }
 
+#if IMGWINDOW_HAS_GLEW
+
+static const char *sVertexShader =
+	"#version 120\n"
+	"uniform mat4 uProjection;\n"
+	"attribute vec2 aPos;\n"
+	"attribute vec2 aUV;\n"
+	"attribute vec4 aColor;\n"
+	"varying vec2 vUV;\n"
+	"varying vec4 vColor;\n"
+	"void main() {\n"
+	"    vUV = aUV;\n"
+	"    vColor = aColor;\n"
+	"    gl_Position = uProjection * vec4(aPos, 0.0, 1.0);\n"
+	"}\n";
+
+static const char *sFragmentShader =
+	"#version 120\n"
+	"uniform sampler2D uTexture;\n"
+	"varying vec2 vUV;\n"
+	"varying vec4 vColor;\n"
+	"void main() {\n"
+	"    gl_FragColor = vColor * texture2D(uTexture, vUV);\n"
+	"}\n";
+
+static GLuint compileShader(GLenum type, const char *source)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, nullptr);
+	glCompileShader(shader);
+
+	GLint ok = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok) {
+		char log[512];
+		glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		XPLMDebugString("ImgWindow: shader compilation failed: ");
+		XPLMDebugString(log);
+		XPLMDebugString("\n");
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+static void multMatrix4f(GLfloat dst[16], const GLfloat a[16], const GLfloat b[16])
+{
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			dst[col * 4 + row] =
+				a[0 * 4 + row] * b[col * 4 + 0] +
+				a[1 * 4 + row] * b[col * 4 + 1] +
+				a[2 * 4 + row] * b[col * 4 + 2] +
+				a[3 * 4 + row] * b[col * 4 + 3];
+		}
+	}
+}
+
+bool
+ImgWindow::initBuffered()
+{
+	if (mProgram) return true;
+	if (mBufferedFailed) return false;
+	mBufferedFailed = true;
+
+	if (!GLEW_VERSION_2_0) {
+		XPLMDebugString("ImgWindow: OpenGL 2.0 unavailable, using the legacy renderer\n");
+		return false;
+	}
+
+	GLuint vs = compileShader(GL_VERTEX_SHADER, sVertexShader);
+	GLuint fs = compileShader(GL_FRAGMENT_SHADER, sFragmentShader);
+	if (!vs || !fs) {
+		if (vs) glDeleteShader(vs);
+		if (fs) glDeleteShader(fs);
+		return false;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	glLinkProgram(program);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	GLint ok = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		XPLMDebugString("ImgWindow: shader link failed, using the legacy renderer\n");
+		glDeleteProgram(program);
+		return false;
+	}
+
+	mProgram = program;
+	mAttribPos = glGetAttribLocation(program, "aPos");
+	mAttribUV = glGetAttribLocation(program, "aUV");
+	mAttribColor = glGetAttribLocation(program, "aColor");
+	mUniformProjection = glGetUniformLocation(program, "uProjection");
+	mUniformTexture = glGetUniformLocation(program, "uTexture");
+	glGenBuffers(1, &mVertexBuffer);
+	glGenBuffers(1, &mIndexBuffer);
+	mUploadedGeneration = ~0u;
+	mBufferedFailed = false;
+	return true;
+}
+
+// Vertex attribute state is shared with X-Plane and other plugins, so the attributes we use are
+// put back exactly as we found them, rather than just disabled.
+struct SavedAttrib {
+	GLint enabled, size, type, normalized, stride, buffer;
+	GLvoid *pointer;
+};
+
+static void
+saveAttrib(GLuint index, SavedAttrib &saved)
+{
+	glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &saved.enabled);
+	glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_SIZE, &saved.size);
+	glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_TYPE, &saved.type);
+	glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &saved.normalized);
+	glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &saved.stride);
+	glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &saved.buffer);
+	glGetVertexAttribPointerv(index, GL_VERTEX_ATTRIB_ARRAY_POINTER, &saved.pointer);
+}
+
+static void
+restoreAttrib(GLuint index, const SavedAttrib &saved)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, saved.buffer);
+	glVertexAttribPointer(index, saved.size, saved.type, (GLboolean)saved.normalized, saved.stride, saved.pointer);
+	if (saved.enabled) glEnableVertexAttribArray(index);
+	else glDisableVertexAttribArray(index);
+}
+
+bool
+ImgWindow::RenderImGuiBuffered(ImDrawData *draw_data)
+{
+	if (!initBuffered()) return false;
+
+	// ImGui space -> boxels (flip Y, offset by the window origin), then through X-Plane's matrices.
+	GLfloat toBoxels[16] = {
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, -1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		static_cast<GLfloat>(mLeft), static_cast<GLfloat>(mTop), 0.0f, 1.0f,
+	};
+	GLfloat modelView[16], projection[16];
+	multMatrix4f(modelView, mModelView, toBoxels);
+	multMatrix4f(projection, mProjection, modelView);
+
+	// The whole transform is affine, so scissor rectangles can be mapped to native pixels with a
+	// single multiply-add per corner instead of two full conversions per draw command.
+	const float sx = projection[0] * 0.5f * mViewport[2];
+	const float sy = projection[5] * 0.5f * mViewport[3];
+	const float ox = (projection[12] * 0.5f + 0.5f) * mViewport[2] + mViewport[0];
+	const float oy = (projection[13] * 0.5f + 0.5f) * mViewport[3] + mViewport[1];
+
+	// 1TU + Alpha settings, no depth, no fog.
+	XPLMSetGraphicsState(0, 1, 0, 1, 1, 0, 0);
+
+	// Save exactly the state we touch, rather than pushing whole attribute groups.
+	GLint lastProgram, lastArrayBuffer, lastElementBuffer, lastScissorBox[4];
+	glGetIntegerv(GL_CURRENT_PROGRAM, &lastProgram);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &lastArrayBuffer);
+	glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &lastElementBuffer);
+	glGetIntegerv(GL_SCISSOR_BOX, lastScissorBox);
+	GLboolean lastScissorTest = glIsEnabled(GL_SCISSOR_TEST);
+	GLboolean lastCullFace = glIsEnabled(GL_CULL_FACE);
+	GLint lastVertexArray = 0;
+	const bool hasVertexArrays = GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object;
+	if (hasVertexArrays) glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &lastVertexArray);
+	SavedAttrib lastPos, lastUV, lastColor;
+	saveAttrib(mAttribPos, lastPos);
+	saveAttrib(mAttribUV, lastUV);
+	saveAttrib(mAttribColor, lastColor);
+
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_SCISSOR_TEST);
+	glUseProgram(mProgram);
+	glUniformMatrix4fv(mUniformProjection, 1, GL_FALSE, projection);
+	glUniform1i(mUniformTexture, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+
+	if (mUploadedGeneration != mDrawDataGeneration) {
+		size_t vtxSize = (size_t)draw_data->TotalVtxCount * sizeof(ImDrawVert);
+		size_t idxSize = (size_t)draw_data->TotalIdxCount * sizeof(ImDrawIdx);
+		while (mVertexBufferSize < vtxSize) mVertexBufferSize = mVertexBufferSize ? mVertexBufferSize * 2 : 65536;
+		while (mIndexBufferSize < idxSize) mIndexBufferSize = mIndexBufferSize ? mIndexBufferSize * 2 : 32768;
+
+		// Orphan the previous storage so the driver never waits on a frame still in flight.
+		glBufferData(GL_ARRAY_BUFFER, mVertexBufferSize, nullptr, GL_STREAM_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndexBufferSize, nullptr, GL_STREAM_DRAW);
+
+		size_t vtxOffset = 0, idxOffset = 0;
+		for (int n = 0; n < draw_data->CmdListsCount; n++) {
+			const ImDrawList *cmd_list = draw_data->CmdLists[n];
+			glBufferSubData(GL_ARRAY_BUFFER, vtxOffset, cmd_list->VtxBuffer.size_in_bytes(), cmd_list->VtxBuffer.Data);
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, idxOffset, cmd_list->IdxBuffer.size_in_bytes(), cmd_list->IdxBuffer.Data);
+			vtxOffset += cmd_list->VtxBuffer.size_in_bytes();
+			idxOffset += cmd_list->IdxBuffer.size_in_bytes();
+		}
+		mUploadedGeneration = mDrawDataGeneration;
+	}
+
+	glEnableVertexAttribArray(mAttribPos);
+	glEnableVertexAttribArray(mAttribUV);
+	glEnableVertexAttribArray(mAttribColor);
+
+	size_t vtxOffset = 0, idxOffset = 0;
+	for (int n = 0; n < draw_data->CmdListsCount; n++)
+	{
+		const ImDrawList* cmd_list = draw_data->CmdLists[n];
+		// Indices are relative to each list, so point the attributes at the list's first vertex.
+		glVertexAttribPointer(mAttribPos, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (const GLvoid*)(vtxOffset + IM_OFFSETOF(ImDrawVert, pos)));
+		glVertexAttribPointer(mAttribUV, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (const GLvoid*)(vtxOffset + IM_OFFSETOF(ImDrawVert, uv)));
+		glVertexAttribPointer(mAttribColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (const GLvoid*)(vtxOffset + IM_OFFSETOF(ImDrawVert, col)));
+
+		for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
+		{
+			const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
+			if (pcmd->UserCallback)	{
+				pcmd->UserCallback(cmd_list, pcmd);
+			} else {
+				XPLMBindTexture2d((GLuint)(intptr_t)pcmd->TextureId, 0);
+
+				float x0 = ox + pcmd->ClipRect.x * sx, x1 = ox + pcmd->ClipRect.z * sx;
+				float y0 = oy + pcmd->ClipRect.y * sy, y1 = oy + pcmd->ClipRect.w * sy;
+				int nLeft = static_cast<int>(x0 < x1 ? x0 : x1);
+				int nRight = static_cast<int>(x0 < x1 ? x1 : x0);
+				int nBottom = static_cast<int>(y0 < y1 ? y0 : y1);
+				int nTop = static_cast<int>(y0 < y1 ? y1 : y0);
+				glScissor(nLeft, nBottom, nRight-nLeft, nTop-nBottom);
+				glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (const GLvoid*)idxOffset);
+			}
+			idxOffset += pcmd->ElemCount * sizeof(ImDrawIdx);
+		}
+		vtxOffset += cmd_list->VtxBuffer.size_in_bytes();
+	}
+
+	// Restore modified state. Attributes live in the vertex array object, so that goes back first.
+	if (hasVertexArrays) glBindVertexArray(lastVertexArray);
+	restoreAttrib(mAttribPos, lastPos);
+	restoreAttrib(mAttribUV, lastUV);
+	restoreAttrib(mAttribColor, lastColor);
+	glUseProgram(lastProgram);
+	glBindBuffer(GL_ARRAY_BUFFER, lastArrayBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lastElementBuffer);
+	glScissor(lastScissorBox[0], lastScissorBox[1], lastScissorBox[2], lastScissorBox[3]);
+	if (!lastScissorTest) glDisable(GL_SCISSOR_TEST);
+	if (lastCullFace) glEnable(GL_CULL_FACE);
+	return true;
+}
+
+#else
+
+bool
+ImgWindow::initBuffered()
+{
+	return false;
+}
+
+bool
+ImgWindow::RenderImGuiBuffered(ImDrawData * /* draw_data */)
+{
+	return false;
+}
+
+#endif
+
+void
+ImgWindow::cacheDrawData(const ImDrawData *draw_data)
+{
+	// Copy the output into draw lists we own, reusing their storage from one rebuild to the next.
+	while ((int)mDrawLists.size() < draw_data->CmdListsCount) {
+		mDrawLists.push_back(IM_NEW(ImDrawList)(ImGui::GetDrawListSharedData()));
+	}
+	for (int n = 0; n < draw_data->CmdListsCount; n++)
+	{
+		const ImDrawList *src = draw_data->CmdLists[n];
+		ImDrawList *dst = mDrawLists[n];
+		dst->CmdBuffer.resize(src->CmdBuffer.Size);
+		dst->IdxBuffer.resize(src->IdxBuffer.Size);
+		dst->VtxBuffer.resize(src->VtxBuffer.Size);
+		memcpy(dst->CmdBuffer.Data, src->CmdBuffer.Data, src->CmdBuffer.size_in_bytes());
+		memcpy(dst->IdxBuffer.Data, src->IdxBuffer.Data, src->IdxBuffer.size_in_bytes());
+		memcpy(dst->VtxBuffer.Data, src->VtxBuffer.Data, src->VtxBuffer.size_in_bytes());
+	}
+	mDrawData = *draw_data;
+	mDrawData.CmdLists = mDrawLists.data();
+	mDrawDataGeneration += 1;
+}
+
 void
 ImgWindow::translateToImguiSpace(int inX, int inY, float &outX, float &outY)
 {
@@ -353,17 +673,16 @@ ImgWindow::updateImgui()
 	ImGui::SetCurrentContext(mImGuiContext);
 	auto &io = ImGui::GetIO();
 
-	// transfer the window geometry to ImGui
-	XPLMGetWindowGeometry(mWindowID, &mLeft, &mTop, &mRight, &mBottom);
-
+	// transfer the window geometry to ImGui (DrawWindowCB keeps it current)
 	float win_width = static_cast<float>(mRight - mLeft);
 	float win_height = static_cast<float>(mTop - mBottom);
 
     // Needed to add this to prevent io.DeltaTime causing a CTD because when X-Plane starts FrameRatePeriod is equal to 0.0f
-    float FrameRatePeriod = XPLMGetDataf(gFrameRatePeriodRef);
-    if (FrameRatePeriod > 0.0f) {
-        io.DeltaTime = XPLMGetDataf(gFrameRatePeriodRef);
+    // We may have skipped frames since the last rebuild, so use the accumulated time.
+    if (mSinceRebuild > 0.0f) {
+        io.DeltaTime = mSinceRebuild;
     }
+    mSinceRebuild = 0.0f;
 	io.DisplaySize = ImVec2(win_width, win_height);
 	// in boxels, we're always scale 1, 1.
 	io.DisplayFramebufferScale = ImVec2(1.0f, 1.0f);
@@ -397,12 +716,34 @@ ImgWindow::DrawWindowCB(XPLMWindowID /* inWindowID */, void *inRefcon)
 {
 	auto *thisWindow = reinterpret_cast<ImgWindow *>(inRefcon);
 
-	thisWindow->updateImgui();
+	// Window moves only need the cached vertices translated, but resizes need a new layout.
+	int left, top, right, bottom;
+	XPLMGetWindowGeometry(thisWindow->mWindowID, &left, &top, &right, &bottom);
+	if (right - left != thisWindow->mRight - thisWindow->mLeft ||
+	    top - bottom != thisWindow->mTop - thisWindow->mBottom) {
+		thisWindow->mDirty = true;
+	}
+	thisWindow->mLeft = left;
+	thisWindow->mTop = top;
+	thisWindow->mRight = right;
+	thisWindow->mBottom = bottom;
+
+	float period = XPLMGetDataf(gFrameRatePeriodRef);
+	if (period > 0.0f) {
+		thisWindow->mSinceRebuild += period;
+	}
 
 	ImGui::SetCurrentContext(thisWindow->mImGuiContext);
-	ImGui::Render();
+	if (thisWindow->mDirty ||
+	    thisWindow->mFirstRender ||
+	    thisWindow->mSinceRebuild >= thisWindow->mRefreshPeriod) {
+		thisWindow->mDirty = false;
+		thisWindow->updateImgui();
+		ImGui::Render();
+		thisWindow->cacheDrawData(ImGui::GetDrawData());
+	}
 
-	thisWindow->RenderImGui(ImGui::GetDrawData());
+	thisWindow->RenderImGui(&thisWindow->mDrawData);
     
     // Give subclasses a chance to do something after all rendering
     thisWindow->afterRendering();
@@ -419,6 +760,7 @@ int
 ImgWindow::HandleMouseClickCB(XPLMWindowID /* inWindowID */, int x, int y, XPLMMouseStatus inMouse, void *inRefcon)
 {
 	auto *thisWindow = reinterpret_cast<ImgWindow *>(inRefcon);
+	thisWindow->mDirty = true;
 	return thisWindow->HandleMouseClickGeneric(x, y, inMouse, 0);
 }
 
@@ -550,6 +892,7 @@ ImgWindow::HandleKeyFuncCB(
 	ImGui::SetCurrentContext(thisWindow->mImGuiContext);
 	ImGuiIO& io = ImGui::GetIO();
 	if (io.WantCaptureKeyboard) {
+		thisWindow->mDirty = true;
         
         // Hack for the Backspace key in VR:
         // Apparently, the virtual VR keyboard sends both the Up and the Down
@@ -595,6 +938,10 @@ ImgWindow::HandleCursorFuncCB(
 	ImGuiIO& io = ImGui::GetIO();
 	float outX, outY;
 	thisWindow->translateToImguiSpace(x, y, outX, outY);
+	// XP calls this every frame the mouse is over us, only hover changes need a rebuild.
+	if (io.MousePos.x != outX || io.MousePos.y != outY) {
+		thisWindow->mDirty = true;
+	}
 	io.MousePos = ImVec2(outX, outY);
 	//FIXME: Maybe we can support imgui's cursors a bit better?
 	return xplm_CursorDefault;
@@ -616,6 +963,7 @@ ImgWindow::HandleMouseWheelFuncCB(
 	float outX, outY;
 	thisWindow->translateToImguiSpace(x, y, outX, outY);
 	io.MousePos = ImVec2(outX, outY);
+	thisWindow->mDirty = true;
 	switch (wheel) {
 	case 0:
 		io.MouseWheel += static_cast<float>(clicks);
@@ -634,6 +982,7 @@ int
 ImgWindow::HandleRightClickFuncCB(XPLMWindowID /* inWindowID */, int x, int y, XPLMMouseStatus inMouse, void *inRefcon)
 {
 	auto *thisWindow = reinterpret_cast<ImgWindow *>(inRefcon);
+	thisWindow->mDirty = true;
 	return thisWindow->HandleMouseClickGeneric(x, y, inMouse, 1);
 }
 
@@ -659,6 +1008,7 @@ ImgWindow::SetVisible(bool inIsVisible)
 			// chance to early abort.
 			return;
 		}
+		mDirty = true;
 	}
 	XPLMSetWindowIsVisible(mWindowID, inIsVisible);
 }
@@ -45,6 +45,7 @@
 #include <XPLMProcessing.h>
 #include <imgui/imgui.h>
 #include <queue>
+#include <vector>
 
 #include "ImgFontAtlas.h"
 
@@ -83,6 +84,20 @@ public:
      */
     static std::shared_ptr<ImgFontAtlas> sFontAtlas;
 
+    /** The ways ImgWindow can draw ImGui's output.
+     *
+     * Buffered streams vertices through buffer objects and draws them with a
+     * small shader. Legacy uses the fixed function pipeline and client-side
+     * arrays, and is used as a fallback whenever Buffered can't be set up.
+     */
+    enum class Renderer { Legacy, Buffered };
+
+    /** Selects the renderer used by all windows from the next frame on. */
+    static void SetRenderer(Renderer renderer) { sRenderer = renderer; }
+
+    /** Returns the renderer requested with SetRenderer(). */
+    static Renderer GetRenderer() { return sRenderer; }
+
     virtual ~ImgWindow();
 
     /** Gets the current window geometry */
@@ -168,6 +183,19 @@ public:
      */
     void SetWindowDragArea (int left=0, int top=0, int right=INT_MAX, int bottom=INT_MAX);
 
+    /** Sets how often the interface is rebuilt while nothing happens in the window.
+     *
+     * Input events (mouse, keyboard, resizing) always trigger a rebuild on the
+     * next frame. Between rebuilds, the last frame's draw data is replayed, so
+     * a window that displays live data only pays for building it at this rate.
+     *
+     * @param hz rebuilds per second, or 0 to rebuild every frame.
+     */
+    void SetRefreshRate(float hz);
+
+    /** Forces the interface to be rebuilt on the next frame. */
+    void MarkDirty() { mDirty = true; }
+
     /** Clear the drag area, ie. stop the drag-the-window functionality */
     void ClearWindowDragArea ();
 
@@ -323,6 +351,14 @@ private:
 
     void RenderImGui(ImDrawData *draw_data);
 
+    void RenderImGuiLegacy(ImDrawData *draw_data);
+
+    bool RenderImGuiBuffered(ImDrawData *draw_data);
+
+    bool initBuffered();
+
+    void cacheDrawData(const ImDrawData *draw_data);
+
     void updateImgui();
 
     void updateMatrices();
@@ -349,6 +385,32 @@ private:
 
     XPLMWindowLayer mPreferredLayer;
 
+    /** Rebuild throttling: the interface is only rebuilt when dirty or when
+     *  mRefreshPeriod has elapsed, otherwise the cached draw data is replayed */
+    bool mDirty = true;
+    float mRefreshPeriod = 0.f;
+    float mSinceRebuild = 0.f;
+    ImDrawData mDrawData;
+    std::vector<ImDrawList *> mDrawLists;
+    unsigned mDrawDataGeneration = 0;
+
+    static Renderer sRenderer;
+
+    /** Buffered renderer state. The buffers are only re-filled when the
+     *  cached draw data changes, so replayed frames cost no vertex upload. */
+    bool mBufferedFailed = false;
+    GLuint mProgram = 0;
+    GLuint mVertexBuffer = 0;
+    GLuint mIndexBuffer = 0;
+    GLint mAttribPos = -1;
+    GLint mAttribUV = -1;
+    GLint mAttribColor = -1;
+    GLint mUniformProjection = -1;
+    GLint mUniformTexture = -1;
+    size_t mVertexBufferSize = 0;
+    size_t mIndexBufferSize = 0;
+    unsigned mUploadedGeneration = ~0u;
+
     /** Shall reset the backspace key? (see HandleKeyFuncCB for details) */
     bool bResetBackspace = false;
 
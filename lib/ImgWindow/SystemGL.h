@@ -3,6 +3,15 @@
 #include <windows.h>            // need to make sure this is read first
 #endif
 
+// When libacfutils is around, go through its GLEW so that the GL 2.0 entry
+// points used by the buffered renderer resolve on every platform.
+#if defined(__has_include)
+#if __has_include(<acfutils/glew.h>)
+#include <acfutils/glew.h>
+#define IMGWINDOW_HAS_GLEW 1
+#endif
+#endif
+
 #ifdef __APPLE__
 #include <OpenGL/gl.h>
 #else
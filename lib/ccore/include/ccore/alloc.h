@@ -0,0 +1,86 @@
+//===--------------------------------------------------------------------------------------------===
+// alloc.h - Arena and fixed-size pool allocators.
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <ccore/memory.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ccarena_block_s ccarena_block_t;
+
+/// A bump allocator. Memory is handed out from large blocks and is only given back all at once,
+/// with ccarena_reset(). Blocks are kept across resets, so an arena that is reset every frame
+/// stops calling the heap once it has grown to the largest frame's needs.
+///
+/// Arenas are not thread-safe: each thread should use its own.
+typedef struct ccarena_s {
+    size_t block_size;
+    ccarena_block_t *first;
+    ccarena_block_t *current;
+    void *last;     // most recent allocation made through the allocator object
+} ccarena_t;
+
+/// Initialises [arena]. Memory is requested from the heap [block_size] bytes at a time, or more
+/// when a single allocation needs it. Nothing is allocated until the first call to
+/// ccarena_alloc().
+void ccarena_init(ccarena_t *arena, size_t block_size);
+
+/// Gives every block owned by [arena] back to the heap.
+void ccarena_deinit(ccarena_t *arena);
+
+/// Allocates [size] bytes from [arena], aligned for any type.
+void *ccarena_alloc(ccarena_t *arena, size_t size);
+
+/// Invalidates everything allocated from [arena], but keeps its blocks for reuse.
+void ccarena_reset(ccarena_t *arena);
+
+/// Returns an allocator object that allocates from [arena]. Freeing through it does nothing,
+/// and reallocating only grows in place if [ptr] is the most recent allocation.
+ccallocator_t ccarena_allocator(ccarena_t *arena);
+
+typedef struct ccfixed_chunk_s ccfixed_chunk_t;
+
+/// A pool of fixed-size objects. Freed objects go on a free list and are handed out again by
+/// the next allocation, so a pool that is sized for the steady state never calls the heap.
+///
+/// Pools are not thread-safe: the thread that owns a pool is the only one that may allocate
+/// from it or free into it. This takes the place of thread-local pools: a thread that needs one
+/// owns it in its own state, as the worker queue and the settings jobs do on the sim thread.
+/// Objects that cross threads are handed back to the owning thread to be freed (the worker's
+/// completions do that), so no pool needs a shared free list or a per-thread cache in front of
+/// one.
+typedef struct ccfixed_s {
+    size_t object_size;
+    size_t chunk_objects;
+    ccfixed_chunk_t *chunks;
+    void *free_list;
+} ccfixed_t;
+
+/// Initialises [pool] to hand out objects of [object_size] bytes, [chunk_objects] of them at a
+/// time.
+void ccfixed_init(ccfixed_t *pool, size_t object_size, size_t chunk_objects);
+
+/// Gives every chunk owned by [pool] back to the heap. Objects still in use become invalid.
+void ccfixed_deinit(ccfixed_t *pool);
+
+/// Returns an object from [pool].
+void *ccfixed_alloc(ccfixed_t *pool);
+
+/// Gives [ptr] back to [pool].
+void ccfixed_free(ccfixed_t *pool, void *ptr);
+
+/// Returns an allocator object that allocates from [pool]. Requests for more than the pool's
+/// object size are a programming error.
+ccallocator_t ccfixed_allocator(ccfixed_t *pool);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -27,6 +27,7 @@ extern "C" {
 #define CCASSERT(expr) do { \
     if(!(expr)) { \
         CCERROR("assertion `" #expr "` failed\n(%s:%03d)", __FILE__, __LINE__); \
+        cc_log_flush(); \
         cc_print_stack(); \
         abort(); \
     } \
@@ -55,6 +56,15 @@ void cc_set_log_name(const char *name);
 
 /// Prints a log message at [level], in function [unit] at [line].
 void cc_log(log_level_t level, const char *function, const char *fmt, ...);
+
+/// Turns asynchronous logging on or off. When it is on, cc_log() never waits on the printer: each
+/// thread queues its messages in its own ring, and they are only printed by cc_log_flush().
+/// Identical messages repeated by a thread are queued at most once per second. Off by default.
+void cc_log_set_async(bool is_async);
+
+/// Prints the messages queued by every thread since the last flush. Call it regularly from one
+/// thread, and once more after turning asynchronous logging off.
+void cc_log_flush(void);
 // void cc_assert(bool expr, const char *readable, const char *file, const char *unit, int line);
 void cc_print(const char *str);
 void cc_printf(const char *str, ...);
@@ -0,0 +1,67 @@
+//===--------------------------------------------------------------------------------------------===
+// map.h - Open-addressing string-keyed hash map.
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <ccore/memory.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// A slot in a map. An empty slot has a hash of zero.
+typedef struct ccmap_slot_s {
+    uint32_t hash;
+    uint32_t key;   // offset of the key in the map's key buffer
+    void *value;
+} ccmap_slot_t;
+
+/// A single-valued, string-indexed hash table. Entries live directly in the slot array (Robin
+/// Hood probing), and keys are copied into one shared buffer, so inserting only allocates when
+/// the map has to grow.
+typedef struct ccmap_s {
+    size_t capacity;
+    size_t size;
+    ccmap_slot_t *slots;
+
+    char *keys;
+    size_t keys_size;
+    size_t keys_capacity;
+    size_t keys_dead;   // bytes used by keys that were removed
+
+    ccallocator_t allocator;
+} ccmap_t;
+
+/// Initialises a map that can hold [count] items before it needs to grow.
+void ccmap_init(ccmap_t *map, size_t count);
+
+/// Initialises a map like ccmap_init(), but takes its memory from [allocator].
+void ccmap_init_with(ccmap_t *map, size_t count, ccallocator_t allocator);
+
+/// De-initialises [map] and call [des] on its contents.
+void ccmap_deinit(ccmap_t *map, cc_destructor des, void *user_data);
+
+/// Maps [key] to [object] in [map]. Does nothing if [key] is already in the map.
+void ccmap_insert(ccmap_t *map, const char *key, void *object);
+
+/// Retrieves the entry mapped to [key] in [map].
+void *ccmap_get_one(const ccmap_t *map, const char *key);
+
+/// Removes [key] from [map], and returns the entry it was mapped to.
+void *ccmap_remove(ccmap_t *map, const char *key);
+
+/// A function that can be used to iterate over a map.
+typedef void (*ccmap_callback_f)(const char *, const void *, void *);
+
+/// Calls [callback] for each element stored in [map], with arbitrary data [ptr].
+void ccmap_iter(const ccmap_t *map, ccmap_callback_f callback, void *ptr);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -33,6 +33,26 @@ void cc_free(void *ptr);
 /// Grows or shrink the memory at [ptr] so that at least [size] bytes are available.
 void *cc_realloc(void *ptr, size_t size);
 
+/// An allocator object that containers can be created with. [fn] behaves like cc_allocator, and
+/// is passed [ctx] as its first argument.
+typedef struct ccallocator_s {
+    void *(*fn)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+} ccallocator_t;
+
+/// The allocator that goes through the function installed with cc_set_allocator().
+extern const ccallocator_t cc_heap_allocator;
+
+/// Allocates [bytes] of memory from [allocator] and returns a pointer to it.
+void *cc_alloc_with(const ccallocator_t *allocator, size_t size);
+
+/// Gives the memory at [ptr] back to [allocator].
+void cc_free_with(const ccallocator_t *allocator, void *ptr);
+
+/// Grows or shrink the memory at [ptr], which was allocated from [allocator], so that at least
+/// [size] bytes are available.
+void *cc_realloc_with(const ccallocator_t *allocator, void *ptr, size_t size);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
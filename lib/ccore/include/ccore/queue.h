@@ -0,0 +1,75 @@
+//===--------------------------------------------------------------------------------------------===
+// queue.h - Bounded lock-free message queues.
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <ccore/message.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// A single-producer, single-consumer ring of messages. Pushing and popping never lock; only
+/// the blocking pop touches a mutex, and only when the queue is empty.
+typedef struct ccspsc_s ccspsc_t;
+
+/// A multi-producer, single-consumer ring of messages. Pushing and popping never lock; only
+/// the blocking pop touches a mutex, and only when the queue is empty.
+typedef struct ccmpsc_s ccmpsc_t;
+
+/// Creates a queue that can hold at least [capacity] messages.
+ccspsc_t *ccspsc_new(size_t capacity);
+
+/// Destroys [queue]. No thread may be using it anymore.
+void ccspsc_delete(ccspsc_t *queue);
+
+/// Pushes [msg] onto [queue]. Returns false if the queue is full. Producer thread only.
+bool ccspsc_push(ccspsc_t *queue, ccmsg_t msg);
+
+/// Pushes up to [count] messages from [msgs], and returns how many were pushed. Producer thread
+/// only.
+size_t ccspsc_push_n(ccspsc_t *queue, const ccmsg_t *msgs, size_t count);
+
+/// Pops the oldest message into [msg]. Returns false if the queue is empty. Consumer thread only.
+bool ccspsc_pop(ccspsc_t *queue, ccmsg_t *msg);
+
+/// Pops up to [max] messages into [msgs], and returns how many were popped. Consumer thread only.
+size_t ccspsc_pop_n(ccspsc_t *queue, ccmsg_t *msgs, size_t max);
+
+/// Pops the oldest message into [msg], waiting up to [timeout_ms] milliseconds for one to arrive.
+/// Returns false if the queue was still empty by then. Consumer thread only.
+bool ccspsc_pop_wait(ccspsc_t *queue, ccmsg_t *msg, uint32_t timeout_ms);
+
+/// Creates a queue that can hold at least [capacity] messages.
+ccmpsc_t *ccmpsc_new(size_t capacity);
+
+/// Destroys [queue]. No thread may be using it anymore.
+void ccmpsc_delete(ccmpsc_t *queue);
+
+/// Pushes [msg] onto [queue]. Returns false if the queue is full. Any thread.
+bool ccmpsc_push(ccmpsc_t *queue, ccmsg_t msg);
+
+/// Pushes up to [count] messages from [msgs], and returns how many were pushed. Messages from a
+/// single call stay in order, but may be interleaved with other producers'. Any thread.
+size_t ccmpsc_push_n(ccmpsc_t *queue, const ccmsg_t *msgs, size_t count);
+
+/// Pops the oldest message into [msg]. Returns false if the queue is empty. Consumer thread only.
+bool ccmpsc_pop(ccmpsc_t *queue, ccmsg_t *msg);
+
+/// Pops up to [max] messages into [msgs], and returns how many were popped. Consumer thread only.
+size_t ccmpsc_pop_n(ccmpsc_t *queue, ccmsg_t *msgs, size_t max);
+
+/// Pops the oldest message into [msg], waiting up to [timeout_ms] milliseconds for one to arrive.
+/// Returns false if the queue was still empty by then. Consumer thread only.
+bool ccmpsc_pop_wait(ccmpsc_t *queue, ccmsg_t *msg, uint32_t timeout_ms);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
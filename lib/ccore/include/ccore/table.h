@@ -34,12 +34,18 @@ typedef struct cctable_s {
     size_t size;
     bool allow_multiple;
     cclist_t *buckets;
+    ccallocator_t allocator;
 } cctable_t;
 
 /// Initialises a table and allocates memory for it. [size] should be close to the maximum
 /// amount of items expected to be stored, so that items are evenly spread in the table.
 void cctable_init(cctable_t *table, size_t count, bool allow_multiple);
 
+/// Initialises a table like cctable_init(), but takes the bucket array and every entry from
+/// [allocator] instead of the heap.
+void cctable_init_with(cctable_t *table, size_t count, bool allow_multiple,
+                       ccallocator_t allocator);
+
 /// De-initialises [table] and call [des] on its contents.
 void cctable_deinit(cctable_t *table, cc_destructor des, void *user_data);
 
@@ -7,6 +7,7 @@
 // =^•.•^=
 //===--------------------------------------------------------------------------------------------===
 #pragma once
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,10 +15,27 @@ extern "C" {
 
 typedef void (*ccpool_task_t)(void *refcon);
 
+/// A task and its argument, for submitting several at once.
+typedef struct {
+    ccpool_task_t fn;
+    void *refcon;
+} ccpool_job_t;
+
+/// Starts the pool with [num_threads] workers. Each worker has its own deque, and idle workers
+/// steal from the others.
 void ccpool_start(int num_threads);
+
+/// Stops the pool. Tasks that haven't started yet are dropped.
 void ccpool_stop();
 
+/// Queues [task] to be called with [refcon]. From a worker, the task goes on that worker's own
+/// deque; from any other thread, on a shared lock-free queue.
 void ccpool_submit(ccpool_task_t task, void *refcon);
+
+/// Queues [count] jobs at once, waking workers only once for the whole batch.
+void ccpool_submit_batch(const ccpool_job_t *jobs, size_t count);
+
+/// Blocks until every submitted task has finished. Must not be called from a worker.
 void ccpool_wait();
 
 #ifdef __cplusplus
@@ -84,23 +84,73 @@ static inline const void *as_ref(value_t value) {
 struct object_s {
     enum {OBJ_LEG, OBJ_STR} kind;
     object_t *next;
+    size_t size;
     bool is_marked;
 };
 
-typedef struct obj_gc_s {
+typedef struct obj_gc_s obj_gc_t;
+
+/// Marks the roots of the object graph, by calling gc_mark() or gc_mark_value() on each of them.
+typedef void (*gc_roots_f)(obj_gc_t *gc, void *user_data);
+
+/// Marks the objects that [obj] references, by calling gc_mark() or gc_mark_value() on them.
+typedef void (*gc_trace_f)(obj_gc_t *gc, object_t *obj, void *user_data);
+
+#define GC_MAX_TEMP_ROOTS (16)
+
+struct obj_gc_s {
     bool mark_flag;
     object_t *head;
-    size_t allocated;
-    size_t next_collect;
-} obj_gc_t;
+    size_t allocated;       // bytes held by live and not-yet-collected objects
+    size_t next_collect;    // collect once [allocated] goes over this
+
+    gc_roots_f roots;
+    gc_trace_f trace;
+    void *user_data;
+
+    // Objects that are marked but haven't been traced yet.
+    object_t **gray;
+    size_t gray_count;
+    size_t gray_capacity;
+
+    // Objects that are still being built, and that no root references yet.
+    object_t *temp_roots[GC_MAX_TEMP_ROOTS];
+    size_t temp_root_count;
+};
 
 int val_compare_wpt(const void *ap, const void *bp);
 int val_compare_string(const void *ap, const void *bp);
 
+/// Initialises [gc]. Until gc_set_tracer() is called, nothing is reachable, so every
+/// collection frees every object.
 void gc_init(obj_gc_t *gc);
+
+/// Frees every object owned by [gc].
 void gc_deinit(obj_gc_t *gc);
+
+/// Sets the functions [gc] uses to find live objects, and the data passed to them.
+void gc_set_tracer(obj_gc_t *gc, gc_roots_f roots, gc_trace_f trace, void *user_data);
+
+/// Marks every object reachable from the roots, and frees the others. The next collection is
+/// scheduled based on how much memory survived.
 void gc_collect(obj_gc_t *gc);
+
+/// Allocates an object of [size] bytes, which must start with an object_t. This may trigger a
+/// collection, so objects that aren't reachable from the roots yet must be pushed on the temporary
+/// root stack first.
 void *gc_new(obj_gc_t *gc, size_t size, int kind);
+
+/// Marks [obj] as reachable. Only valid while [gc] is collecting.
+void gc_mark(obj_gc_t *gc, object_t *obj);
+
+/// Marks the object [value] references, if there is one. Only valid while [gc] is collecting.
+void gc_mark_value(obj_gc_t *gc, value_t value);
+
+/// Keeps [obj] alive until the matching call to gc_pop_root().
+void gc_push_root(obj_gc_t *gc, object_t *obj);
+
+/// Pops the last object pushed with gc_push_root().
+void gc_pop_root(obj_gc_t *gc);
 void value_debug(value_t value);
 
 #ifdef __cplusplus
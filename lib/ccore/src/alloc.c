@@ -0,0 +1,207 @@
+//===--------------------------------------------------------------------------------------------===
+// alloc.c - Arena and fixed-size pool allocators.
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include <ccore/alloc.h>
+#include <ccore/log.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ALIGNMENT (alignof(max_align_t))
+
+static inline size_t align_up(size_t size) {
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+// MARK: - Arena
+
+struct ccarena_block_s {
+    ccarena_block_t *next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+};
+
+// Allocations made through the allocator object carry their size, so they can be copied when
+// they are reallocated.
+typedef struct {
+    alignas(max_align_t) size_t size;
+} arena_header_t;
+
+void ccarena_init(ccarena_t *arena, size_t block_size) {
+    CCASSERT(arena);
+    arena->block_size = block_size;
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->last = NULL;
+}
+
+void ccarena_deinit(ccarena_t *arena) {
+    CCASSERT(arena);
+    ccarena_block_t *block = arena->first;
+    while(block) {
+        ccarena_block_t *next = block->next;
+        cc_free(block);
+        block = next;
+    }
+    ccarena_init(arena, arena->block_size);
+}
+
+static ccarena_block_t *arena_block_new(size_t size) {
+    ccarena_block_t *block = cc_alloc(sizeof(ccarena_block_t) + size);
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void *ccarena_alloc(ccarena_t *arena, size_t size) {
+    CCASSERT(arena);
+    size = align_up(size ? size : 1);
+    arena->last = NULL;
+
+    ccarena_block_t *block = arena->current;
+    if(block && block->size - block->used >= size) goto found;
+
+    // Blocks after the current one are left over from before the last reset, and are empty.
+    // Any that are too small for this allocation are skipped.
+    for(block = block ? block->next : arena->first; block; block = block->next) {
+        if(block->size >= size) goto found;
+    }
+
+    size_t block_size = size > arena->block_size ? size : arena->block_size;
+    block = arena_block_new(block_size);
+    if(arena->current) {
+        block->next = arena->current->next;
+        arena->current->next = block;
+    } else {
+        block->next = arena->first;
+        arena->first = block;
+    }
+
+found:
+    arena->current = block;
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+void ccarena_reset(ccarena_t *arena) {
+    CCASSERT(arena);
+    for(ccarena_block_t *block = arena->first; block; block = block->next) {
+        block->used = 0;
+    }
+    arena->current = arena->first;
+    arena->last = NULL;
+}
+
+static void *arena_fn(void *ctx, void *ptr, size_t size) {
+    ccarena_t *arena = ctx;
+    if(!size) return NULL;
+
+    size_t old_size = 0;
+    if(ptr) {
+        arena_header_t *header = (arena_header_t *)ptr - 1;
+        old_size = header->size;
+        if(size <= old_size) return ptr;
+
+        // The most recent allocation can grow without moving, if its block has room left.
+        ccarena_block_t *block = arena->current;
+        size_t grow = align_up(size) - align_up(old_size);
+        if(ptr == arena->last && block->size - block->used >= grow) {
+            block->used += grow;
+            header->size = size;
+            return ptr;
+        }
+    }
+
+    arena_header_t *header = ccarena_alloc(arena, sizeof(arena_header_t) + size);
+    header->size = size;
+    void *new_ptr = header + 1;
+    if(ptr) memcpy(new_ptr, ptr, old_size);
+    arena->last = new_ptr;
+    return new_ptr;
+}
+
+ccallocator_t ccarena_allocator(ccarena_t *arena) {
+    CCASSERT(arena);
+    return (ccallocator_t){arena_fn, arena};
+}
+
+// MARK: - Fixed-size pool
+
+struct ccfixed_chunk_s {
+    ccfixed_chunk_t *next;
+    alignas(max_align_t) unsigned char data[];
+};
+
+void ccfixed_init(ccfixed_t *pool, size_t object_size, size_t chunk_objects) {
+    CCASSERT(pool);
+    CCASSERT(chunk_objects);
+    // Free objects store the free list link in their first bytes.
+    if(object_size < sizeof(void *)) object_size = sizeof(void *);
+    pool->object_size = align_up(object_size);
+    pool->chunk_objects = chunk_objects;
+    pool->chunks = NULL;
+    pool->free_list = NULL;
+}
+
+void ccfixed_deinit(ccfixed_t *pool) {
+    CCASSERT(pool);
+    ccfixed_chunk_t *chunk = pool->chunks;
+    while(chunk) {
+        ccfixed_chunk_t *next = chunk->next;
+        cc_free(chunk);
+        chunk = next;
+    }
+    pool->chunks = NULL;
+    pool->free_list = NULL;
+}
+
+static void fixed_grow(ccfixed_t *pool) {
+    ccfixed_chunk_t *chunk = cc_alloc(sizeof(ccfixed_chunk_t) + pool->object_size * pool->chunk_objects);
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+
+    // Thread the new objects in address order, so they get handed out that way too.
+    for(size_t i = pool->chunk_objects; i > 0; --i) {
+        void **obj = (void **)(chunk->data + (i - 1) * pool->object_size);
+        *obj = pool->free_list;
+        pool->free_list = obj;
+    }
+}
+
+void *ccfixed_alloc(ccfixed_t *pool) {
+    CCASSERT(pool);
+    if(!pool->free_list) fixed_grow(pool);
+    void **obj = pool->free_list;
+    pool->free_list = *obj;
+    return obj;
+}
+
+void ccfixed_free(ccfixed_t *pool, void *ptr) {
+    CCASSERT(pool);
+    if(!ptr) return;
+    *(void **)ptr = pool->free_list;
+    pool->free_list = ptr;
+}
+
+static void *fixed_fn(void *ctx, void *ptr, size_t size) {
+    ccfixed_t *pool = ctx;
+    if(!size) {
+        ccfixed_free(pool, ptr);
+        return NULL;
+    }
+    CCASSERT(size <= pool->object_size);
+    return ptr ? ptr : ccfixed_alloc(pool);
+}
+
+ccallocator_t ccfixed_allocator(ccfixed_t *pool) {
+    CCASSERT(pool);
+    return (ccallocator_t){fixed_fn, pool};
+}
@@ -0,0 +1,23 @@
+//===--------------------------------------------------------------------------------------------===
+// hash - private header for string hashing
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <ccore/log.h>
+#include <stddef.h>
+
+static inline size_t hash_string(const char *string) {
+    CCASSERT(string);
+    //Fowler-Noll-Vo 1a hash
+    // http://www.isthe.com/chongo/src/fnv/hash_64.c
+    // http://create.stephan-brumme.com/fnv-hash/
+    size_t hash = 0x84222325cbf29ce4ULL;
+    for(size_t i = 0; string[i] != '\0'; ++i) {
+        hash = (hash ^ string[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
@@ -8,9 +8,47 @@
 //===--------------------------------------------------------------------------------------------===
 #include <ccore/log.h>
 #include <stdio.h>
+#include <string.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 #include <ccore/math.h>
+#include "hash.h"
+
+// In asynchronous mode, each thread that logs gets one of a fixed set of rings, which only it
+// writes to. Messages are formatted on the thread that logs them (the arguments can't be trusted
+// to outlive the call), and printed when someone calls cc_log_flush(). Threads that can't get a
+// ring fall back to printing synchronously.
+#define LOG_MAX_RINGS (16)
+#define LOG_RING_SIZE (64)
+#define LOG_ENTRY_SIZE (256)
+#define LOG_MESSAGE_SIZE (LOG_ENTRY_SIZE - 64) // leaves room for the repeat count and newline
+
+// A message identical to the one before it on the same thread is only queued once per period.
+// The copies in between are counted, and the count is reported with the next message.
+#define LOG_REPEAT_PERIOD_NSEC (1000000000ULL)
+
+typedef struct {
+    _Atomic bool in_use;
+    _Atomic size_t head;
+    _Atomic size_t tail;
+    _Atomic size_t dropped;
+
+    // Only touched by the thread that owns the ring.
+    size_t last_hash;
+    uint64_t last_time;
+    size_t repeats;
+
+    char entries[LOG_RING_SIZE][LOG_ENTRY_SIZE];
+} log_ring_t;
+
 static pthread_mutex_t stream_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic bool log_is_async = false;
+static log_ring_t log_rings[LOG_MAX_RINGS];
+static _Thread_local log_ring_t *thread_ring = NULL;
+static _Thread_local bool thread_has_no_ring = false;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
 
 static void default_printer(const char *str) {
     fprintf(stderr, "%s", str);
@@ -37,8 +75,139 @@ void cc_set_printer(void (*printer)(const char *)) {
     log_printer = printer;
 }
 
+// MARK: - Asynchronous logging
+
+static uint64_t now_nsec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Unfinished messages in a released ring are still printed by the next flush, and a thread that
+// claims the ring later carries on where the last owner stopped.
+static void ring_release(void *ptr) {
+    log_ring_t *ring = ptr;
+    atomic_store_explicit(&ring->in_use, false, memory_order_release);
+}
+
+static void ring_make_key() {
+    pthread_key_create(&ring_key, ring_release);
+}
+
+static log_ring_t *ring_get() {
+    if(thread_ring) return thread_ring;
+    if(thread_has_no_ring) return NULL;
+
+    pthread_once(&ring_key_once, ring_make_key);
+    for(int i = 0; i < LOG_MAX_RINGS; ++i) {
+        bool expected = false;
+        if(!atomic_compare_exchange_strong(&log_rings[i].in_use, &expected, true)) continue;
+        thread_ring = &log_rings[i];
+        thread_ring->last_hash = 0;
+        thread_ring->repeats = 0;
+        pthread_setspecific(ring_key, thread_ring);
+        return thread_ring;
+    }
+    thread_has_no_ring = true;
+    return NULL;
+}
+
+static char *ring_reserve(log_ring_t *ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if(tail - head >= LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return NULL;
+    }
+    return ring->entries[tail % LOG_RING_SIZE];
+}
+
+static void ring_commit(log_ring_t *ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+static void ring_push_repeats(log_ring_t *ring) {
+    if(!ring->repeats) return;
+    char *entry = ring_reserve(ring);
+    if(entry) {
+        snprintf(entry, LOG_ENTRY_SIZE, "[%s] last message repeated %zu more times\n",
+                 log_name, ring->repeats);
+        ring_commit(ring);
+    }
+    ring->repeats = 0;
+}
+
+static void log_async(log_ring_t *ring, log_level_t level, const char *function,
+                      const char *fmt, va_list args) {
+    char message[LOG_MESSAGE_SIZE];
+    int length = snprintf(message, LOG_MESSAGE_SIZE, "[%s %s] %s(): ",
+                          log_name, level_string(level), function);
+    if(length < 0 || length >= LOG_MESSAGE_SIZE) length = 0;
+    vsnprintf(message + length, LOG_MESSAGE_SIZE - length, fmt, args);
+
+    size_t hash = hash_string(message);
+    uint64_t now = now_nsec();
+    if(hash == ring->last_hash && now - ring->last_time < LOG_REPEAT_PERIOD_NSEC) {
+        ring->repeats += 1;
+        return;
+    }
+    if(hash != ring->last_hash) ring_push_repeats(ring);
+
+    char *entry = ring_reserve(ring);
+    if(!entry) return;
+    if(ring->repeats) {
+        snprintf(entry, LOG_ENTRY_SIZE, "%s (repeated %zu more times)\n", message, ring->repeats);
+        ring->repeats = 0;
+    } else {
+        snprintf(entry, LOG_ENTRY_SIZE, "%s\n", message);
+    }
+    ring_commit(ring);
+    ring->last_hash = hash;
+    ring->last_time = now;
+}
+
+void cc_log_set_async(bool is_async) {
+    atomic_store(&log_is_async, is_async);
+}
+
+void cc_log_flush() {
+    pthread_mutex_lock(&stream_mutex);
+    for(int i = 0; i < LOG_MAX_RINGS; ++i) {
+        log_ring_t *ring = &log_rings[i];
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        for(; head != tail; ++head) {
+            log_printer(ring->entries[head % LOG_RING_SIZE]);
+        }
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+
+        size_t dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+        if(dropped) {
+            char buffer[128];
+            snprintf(buffer, 128, "[%s] log buffer full, %zu messages dropped\n", log_name, dropped);
+            log_printer(buffer);
+        }
+    }
+    pthread_mutex_unlock(&stream_mutex);
+}
+
+// MARK: - Logging
+
 void cc_log(log_level_t level, const char *function, const char *fmt, ...) {
     if(level < LOG_LEVEL) return;
+
+    if(atomic_load_explicit(&log_is_async, memory_order_relaxed)) {
+        log_ring_t *ring = ring_get();
+        if(ring) {
+            va_list args;
+            va_start(args, fmt);
+            log_async(ring, level, function, fmt, args);
+            va_end(args);
+            return;
+        }
+    }
+
     pthread_mutex_lock(&stream_mutex);
 
     char buffer[512];
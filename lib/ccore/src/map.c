@@ -0,0 +1,213 @@
+//===--------------------------------------------------------------------------------------------===
+// map.c - Open-addressing string-keyed hash map.
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include <ccore/map.h>
+#include <ccore/log.h>
+#include <string.h>
+#include "hash.h"
+
+#define MIN_CAPACITY (8)
+
+// The map grows once it is 7/8th full. Robin Hood probing keeps probe sequences short even at
+// that load.
+static inline bool is_overloaded(size_t size, size_t capacity) {
+    return size * 8 > capacity * 7;
+}
+
+static inline uint32_t map_hash(const char *key) {
+    uint32_t hash = (uint32_t)hash_string(key);
+    return hash ? hash : 1;
+}
+
+static inline size_t probe_distance(const ccmap_t *map, size_t pos, uint32_t hash) {
+    return (pos - hash) & (map->capacity - 1);
+}
+
+static ccmap_slot_t *find_slot(const ccmap_t *map, const char *key, uint32_t hash) {
+    size_t mask = map->capacity - 1;
+    size_t pos = hash & mask;
+
+    for(size_t dist = 0;; ++dist, pos = (pos + 1) & mask) {
+        ccmap_slot_t *slot = &map->slots[pos];
+        if(!slot->hash) return NULL;
+        // Every entry past this point is closer to home than [key] would be, so it can't be there.
+        if(probe_distance(map, pos, slot->hash) < dist) return NULL;
+        if(slot->hash == hash && !strcmp(map->keys + slot->key, key)) return slot;
+    }
+}
+
+static void place_slot(ccmap_t *map, ccmap_slot_t entry) {
+    size_t mask = map->capacity - 1;
+    size_t pos = entry.hash & mask;
+
+    for(size_t dist = 0;; ++dist, pos = (pos + 1) & mask) {
+        ccmap_slot_t *slot = &map->slots[pos];
+        if(!slot->hash) {
+            *slot = entry;
+            return;
+        }
+        // Take the slot from entries that are closer to their home than we are, and keep
+        // looking for a place for them instead.
+        size_t slot_dist = probe_distance(map, pos, slot->hash);
+        if(slot_dist < dist) {
+            ccmap_slot_t tmp = *slot;
+            *slot = entry;
+            entry = tmp;
+            dist = slot_dist;
+        }
+    }
+}
+
+static void alloc_slots(ccmap_t *map, size_t capacity) {
+    map->capacity = capacity;
+    map->slots = cc_alloc_with(&map->allocator, capacity * sizeof(ccmap_slot_t));
+    memset(map->slots, 0, capacity * sizeof(ccmap_slot_t));
+}
+
+// Rebuilds the slot array with [capacity] slots. Keys of removed entries are dropped from the
+// key buffer at the same time.
+static void rehash(ccmap_t *map, size_t capacity) {
+    ccmap_slot_t *old_slots = map->slots;
+    size_t old_capacity = map->capacity;
+    char *old_keys = map->keys;
+
+    if(map->keys_dead) {
+        map->keys = cc_alloc_with(&map->allocator, map->keys_capacity);
+        map->keys_size = 0;
+        map->keys_dead = 0;
+    }
+
+    alloc_slots(map, capacity);
+    for(size_t i = 0; i < old_capacity; ++i) {
+        ccmap_slot_t entry = old_slots[i];
+        if(!entry.hash) continue;
+        if(old_keys != map->keys) {
+            const char *key = old_keys + entry.key;
+            size_t length = strlen(key) + 1;
+            memcpy(map->keys + map->keys_size, key, length);
+            entry.key = (uint32_t)map->keys_size;
+            map->keys_size += length;
+        }
+        place_slot(map, entry);
+    }
+
+    cc_free_with(&map->allocator, old_slots);
+    if(old_keys != map->keys) cc_free_with(&map->allocator, old_keys);
+}
+
+static uint32_t store_key(ccmap_t *map, const char *key) {
+    size_t length = strlen(key) + 1;
+    size_t required = map->keys_size + length;
+    CCASSERT(required <= UINT32_MAX);
+
+    if(required > map->keys_capacity) {
+        size_t capacity = map->keys_capacity ? map->keys_capacity : 256;
+        while(capacity < required) capacity *= 2;
+        map->keys = cc_realloc_with(&map->allocator, map->keys, capacity);
+        map->keys_capacity = capacity;
+    }
+
+    uint32_t offset = (uint32_t)map->keys_size;
+    memcpy(map->keys + offset, key, length);
+    map->keys_size = required;
+    return offset;
+}
+
+void ccmap_init(ccmap_t *map, size_t count) {
+    ccmap_init_with(map, count, cc_heap_allocator);
+}
+
+void ccmap_init_with(ccmap_t *map, size_t count, ccallocator_t allocator) {
+    CCASSERT(map);
+    map->allocator = allocator;
+    map->size = 0;
+    map->keys = NULL;
+    map->keys_size = 0;
+    map->keys_capacity = 0;
+    map->keys_dead = 0;
+
+    size_t capacity = MIN_CAPACITY;
+    while(is_overloaded(count, capacity)) capacity *= 2;
+    alloc_slots(map, capacity);
+}
+
+void ccmap_deinit(ccmap_t *map, cc_destructor des, void *user_data) {
+    CCASSERT(map);
+    if(des) {
+        for(size_t i = 0; i < map->capacity; ++i) {
+            if(map->slots[i].hash) des(map->slots[i].value, user_data);
+        }
+    }
+    cc_free_with(&map->allocator, map->slots);
+    cc_free_with(&map->allocator, map->keys);
+    map->slots = NULL;
+    map->keys = NULL;
+    map->capacity = 0;
+    map->size = 0;
+    map->keys_size = 0;
+    map->keys_capacity = 0;
+    map->keys_dead = 0;
+}
+
+void ccmap_insert(ccmap_t *map, const char *key, void *object) {
+    CCASSERT(map);
+    CCASSERT(key);
+    uint32_t hash = map_hash(key);
+    if(find_slot(map, key, hash)) return;
+
+    if(is_overloaded(map->size + 1, map->capacity)) {
+        rehash(map, map->capacity * 2);
+    } else if(map->keys_dead > map->keys_size / 2) {
+        rehash(map, map->capacity);
+    }
+
+    ccmap_slot_t entry = {.hash = hash, .key = store_key(map, key), .value = object};
+    place_slot(map, entry);
+    map->size += 1;
+}
+
+void *ccmap_get_one(const ccmap_t *map, const char *key) {
+    CCASSERT(map);
+    CCASSERT(key);
+    ccmap_slot_t *slot = find_slot(map, key, map_hash(key));
+    return slot ? slot->value : NULL;
+}
+
+void *ccmap_remove(ccmap_t *map, const char *key) {
+    CCASSERT(map);
+    CCASSERT(key);
+    ccmap_slot_t *slot = find_slot(map, key, map_hash(key));
+    if(!slot) return NULL;
+
+    void *value = slot->value;
+    map->keys_dead += strlen(map->keys + slot->key) + 1;
+    map->size -= 1;
+
+    // Shift the entries that follow back by one, until one is already in its home slot. That
+    // keeps probe sequences unbroken without tombstones.
+    size_t mask = map->capacity - 1;
+    size_t pos = (size_t)(slot - map->slots);
+    for(;;) {
+        size_t next = (pos + 1) & mask;
+        ccmap_slot_t *next_slot = &map->slots[next];
+        if(!next_slot->hash || !probe_distance(map, next, next_slot->hash)) break;
+        map->slots[pos] = *next_slot;
+        pos = next;
+    }
+    memset(&map->slots[pos], 0, sizeof(ccmap_slot_t));
+    return value;
+}
+
+void ccmap_iter(const ccmap_t *map, ccmap_callback_f callback, void *ptr) {
+    CCASSERT(map);
+    CCASSERT(callback);
+    for(size_t i = 0; i < map->capacity; ++i) {
+        const ccmap_slot_t *slot = &map->slots[i];
+        if(slot->hash) callback(map->keys + slot->key, slot->value, ptr);
+    }
+}
@@ -41,3 +41,25 @@ void cc_free(void *ptr) {
 void *cc_realloc(void *ptr, size_t size) {
     return __cc_alloc(ptr, size);
 }
+
+static void *cc_heap_fn(void *ctx, void *ptr, size_t size) {
+    CCUNUSED(ctx);
+    return __cc_alloc(ptr, size);
+}
+
+const ccallocator_t cc_heap_allocator = {cc_heap_fn, NULL};
+
+void *cc_alloc_with(const ccallocator_t *allocator, size_t size) {
+    CCASSERT(allocator);
+    return allocator->fn(allocator->ctx, NULL, size);
+}
+
+void cc_free_with(const ccallocator_t *allocator, void *ptr) {
+    CCASSERT(allocator);
+    if(ptr) allocator->fn(allocator->ctx, ptr, 0);
+}
+
+void *cc_realloc_with(const ccallocator_t *allocator, void *ptr, size_t size) {
+    CCASSERT(allocator);
+    return allocator->fn(allocator->ctx, ptr, size);
+}
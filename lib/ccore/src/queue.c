@@ -0,0 +1,288 @@
+//===--------------------------------------------------------------------------------------------===
+// queue.c - Bounded lock-free message queues.
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include <ccore/queue.h>
+#include <ccore/memory.h>
+#include <ccore/log.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define CACHE_LINE (64)
+
+// Lets the consumer sleep when the queue is empty. Producers only take the lock if the consumer
+// has said it's going to sleep: the consumer raises [is_waiting] before checking the queue one
+// last time, producers publish before reading [is_waiting], so one always sees the other.
+typedef struct {
+    _Atomic bool is_waiting;
+    pthread_mutex_t mt;
+    pthread_cond_t cv;
+} waiter_t;
+
+// Head and tail live on their own cache lines, next to the copy of the other end each side keeps
+// so it doesn't have to read the shared one on every call.
+struct ccspsc_s {
+    _Atomic size_t head;
+    size_t tail_cache;
+    char pad0[CACHE_LINE - sizeof(size_t) * 2];
+
+    _Atomic size_t tail;
+    size_t head_cache;
+    char pad1[CACHE_LINE - sizeof(size_t) * 2];
+
+    waiter_t waiter;
+    size_t mask;
+    ccmsg_t slots[];
+};
+
+typedef struct {
+    _Atomic size_t seq;
+    ccmsg_t msg;
+} mpsc_cell_t;
+
+// Bounded queue with a sequence number per cell (D. Vyukov's design): producers claim a cell by
+// bumping [tail], and mark it ready by publishing its sequence number.
+struct ccmpsc_s {
+    _Atomic size_t tail;
+    char pad0[CACHE_LINE - sizeof(size_t)];
+
+    size_t head;
+    char pad1[CACHE_LINE - sizeof(size_t)];
+
+    waiter_t waiter;
+    size_t mask;
+    mpsc_cell_t cells[];
+};
+
+static size_t round_capacity(size_t capacity) {
+    size_t size = 2;
+    while(size < capacity) size <<= 1;
+    return size;
+}
+
+// MARK: - Blocking
+
+static void waiter_init(waiter_t *waiter) {
+    atomic_init(&waiter->is_waiting, false);
+    pthread_mutex_init(&waiter->mt, NULL);
+    pthread_cond_init(&waiter->cv, NULL);
+}
+
+static void waiter_deinit(waiter_t *waiter) {
+    pthread_mutex_destroy(&waiter->mt);
+    pthread_cond_destroy(&waiter->cv);
+}
+
+static void waiter_notify(waiter_t *waiter) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if(!atomic_load_explicit(&waiter->is_waiting, memory_order_relaxed)) return;
+    pthread_mutex_lock(&waiter->mt);
+    pthread_cond_signal(&waiter->cv);
+    pthread_mutex_unlock(&waiter->mt);
+}
+
+typedef bool (*pop_fn_t)(void *queue, ccmsg_t *msg);
+
+static bool waiter_pop(waiter_t *waiter, void *queue, pop_fn_t pop, ccmsg_t *msg, uint32_t timeout_ms) {
+    if(pop(queue, msg)) return true;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    bool ok = false;
+    pthread_mutex_lock(&waiter->mt);
+    atomic_store(&waiter->is_waiting, true);
+    atomic_thread_fence(memory_order_seq_cst);
+    for(;;) {
+        if((ok = pop(queue, msg))) break;
+        if(pthread_cond_timedwait(&waiter->cv, &waiter->mt, &deadline) == ETIMEDOUT) {
+            ok = pop(queue, msg);
+            break;
+        }
+    }
+    atomic_store(&waiter->is_waiting, false);
+    pthread_mutex_unlock(&waiter->mt);
+    return ok;
+}
+
+// MARK: - SPSC
+
+ccspsc_t *ccspsc_new(size_t capacity) {
+    size_t size = round_capacity(capacity);
+    ccspsc_t *queue = cc_alloc(sizeof(ccspsc_t) + size * sizeof(ccmsg_t));
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->tail_cache = 0;
+    queue->head_cache = 0;
+    queue->mask = size - 1;
+    waiter_init(&queue->waiter);
+    return queue;
+}
+
+void ccspsc_delete(ccspsc_t *queue) {
+    CCASSERT(queue);
+    waiter_deinit(&queue->waiter);
+    cc_free(queue);
+}
+
+size_t ccspsc_push_n(ccspsc_t *queue, const ccmsg_t *msgs, size_t count) {
+    CCASSERT(queue);
+    CCASSERT(msgs || !count);
+    size_t capacity = queue->mask + 1;
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    if(capacity - (tail - queue->head_cache) < count) {
+        queue->head_cache = atomic_load_explicit(&queue->head, memory_order_acquire);
+    }
+    size_t space = capacity - (tail - queue->head_cache);
+    if(count > space) count = space;
+    if(!count) return 0;
+
+    for(size_t i = 0; i < count; ++i) {
+        queue->slots[(tail + i) & queue->mask] = msgs[i];
+    }
+    atomic_store_explicit(&queue->tail, tail + count, memory_order_release);
+    waiter_notify(&queue->waiter);
+    return count;
+}
+
+bool ccspsc_push(ccspsc_t *queue, ccmsg_t msg) {
+    return ccspsc_push_n(queue, &msg, 1) == 1;
+}
+
+size_t ccspsc_pop_n(ccspsc_t *queue, ccmsg_t *msgs, size_t max) {
+    CCASSERT(queue);
+    CCASSERT(msgs || !max);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    if(queue->tail_cache - head < max) {
+        queue->tail_cache = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    }
+    size_t available = queue->tail_cache - head;
+    size_t count = max < available ? max : available;
+    if(!count) return 0;
+
+    for(size_t i = 0; i < count; ++i) {
+        msgs[i] = queue->slots[(head + i) & queue->mask];
+    }
+    atomic_store_explicit(&queue->head, head + count, memory_order_release);
+    return count;
+}
+
+bool ccspsc_pop(ccspsc_t *queue, ccmsg_t *msg) {
+    return ccspsc_pop_n(queue, msg, 1) == 1;
+}
+
+static bool spsc_pop(void *queue, ccmsg_t *msg) {
+    return ccspsc_pop(queue, msg);
+}
+
+bool ccspsc_pop_wait(ccspsc_t *queue, ccmsg_t *msg, uint32_t timeout_ms) {
+    CCASSERT(queue);
+    return waiter_pop(&queue->waiter, queue, spsc_pop, msg, timeout_ms);
+}
+
+// MARK: - MPSC
+
+ccmpsc_t *ccmpsc_new(size_t capacity) {
+    size_t size = round_capacity(capacity);
+    ccmpsc_t *queue = cc_alloc(sizeof(ccmpsc_t) + size * sizeof(mpsc_cell_t));
+    atomic_init(&queue->tail, 0);
+    queue->head = 0;
+    queue->mask = size - 1;
+    for(size_t i = 0; i < size; ++i) {
+        atomic_init(&queue->cells[i].seq, i);
+    }
+    waiter_init(&queue->waiter);
+    return queue;
+}
+
+void ccmpsc_delete(ccmpsc_t *queue) {
+    CCASSERT(queue);
+    waiter_deinit(&queue->waiter);
+    cc_free(queue);
+}
+
+static bool mpsc_push(ccmpsc_t *queue, ccmsg_t msg) {
+    mpsc_cell_t *cell = NULL;
+    size_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    for(;;) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if(diff == 0) {
+            if(atomic_compare_exchange_weak_explicit(&queue->tail, &pos, pos + 1,
+                                                     memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if(diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+
+    cell->msg = msg;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+bool ccmpsc_push(ccmpsc_t *queue, ccmsg_t msg) {
+    CCASSERT(queue);
+    if(!mpsc_push(queue, msg)) return false;
+    waiter_notify(&queue->waiter);
+    return true;
+}
+
+size_t ccmpsc_push_n(ccmpsc_t *queue, const ccmsg_t *msgs, size_t count) {
+    CCASSERT(queue);
+    CCASSERT(msgs || !count);
+    size_t pushed = 0;
+    while(pushed < count && mpsc_push(queue, msgs[pushed])) pushed += 1;
+    if(pushed) waiter_notify(&queue->waiter);
+    return pushed;
+}
+
+size_t ccmpsc_pop_n(ccmpsc_t *queue, ccmsg_t *msgs, size_t max) {
+    CCASSERT(queue);
+    CCASSERT(msgs || !max);
+    size_t count = 0;
+
+    while(count < max) {
+        mpsc_cell_t *cell = &queue->cells[queue->head & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        if(seq != queue->head + 1) break;
+
+        msgs[count++] = cell->msg;
+        atomic_store_explicit(&cell->seq, queue->head + queue->mask + 1, memory_order_release);
+        queue->head += 1;
+    }
+    return count;
+}
+
+bool ccmpsc_pop(ccmpsc_t *queue, ccmsg_t *msg) {
+    return ccmpsc_pop_n(queue, msg, 1) == 1;
+}
+
+static bool mpsc_pop(void *queue, ccmsg_t *msg) {
+    return ccmpsc_pop(queue, msg);
+}
+
+bool ccmpsc_pop_wait(ccmpsc_t *queue, ccmsg_t *msg, uint32_t timeout_ms) {
+    CCASSERT(queue);
+    return waiter_pop(&queue->waiter, queue, mpsc_pop, msg, timeout_ms);
+}
@@ -10,6 +10,7 @@
 #include <ccore/log.h>
 #include <ccore/memory.h>
 #include <string.h>
+#include "hash.h"
 
 static inline size_t next_power_of_2(size_t v) {
     v -= 1;
@@ -22,23 +23,17 @@ static inline size_t next_power_of_2(size_t v) {
     return v;
 }
 
-static size_t hash_string(const char *string) {
-    CCASSERT(string);
-    //Fowler-Noll-Vo 1a hash
-    // http://www.isthe.com/chongo/src/fnv/hash_64.c
-    // http://create.stephan-brumme.com/fnv-hash/
-    size_t hash = 0x84222325cbf29ce4ULL;
-    for(size_t i = 0; string[i] != '\0'; ++i) {
-        hash = (hash ^ string[i]) * 0x100000001b3ULL;
-    }
-    return hash;
+void cctable_init(cctable_t *table, size_t count, bool allow_multiple) {
+    cctable_init_with(table, count, allow_multiple, cc_heap_allocator);
 }
 
-void cctable_init(cctable_t *table, size_t count, bool allow_multiple) {
+void cctable_init_with(cctable_t *table, size_t count, bool allow_multiple,
+                       ccallocator_t allocator) {
     CCASSERT(table);
     table->size = 0;
     table->capacity = next_power_of_2(count);
-    table->buckets = cc_alloc(table->capacity * sizeof(cctable_t));
+    table->allocator = allocator;
+    table->buckets = cc_alloc_with(&table->allocator, table->capacity * sizeof(cclist_t));
     table->allow_multiple = allow_multiple;
 
     for(size_t i = 0; i < table->capacity; ++i) {
@@ -47,6 +42,7 @@ void cctable_init(cctable_t *table, size_t count, bool allow_multiple) {
 }
 
 struct destructor_data {
+    const ccallocator_t *allocator;
     cc_destructor destructor;
     void *user_data;
 };
@@ -55,27 +51,28 @@ static void node_destructor_single(void *ptr, void *meta) {
     ccbucket_node_t *node = ptr;
     struct destructor_data *data = meta;
     if(data->destructor) data->destructor(node->one_value, data->user_data);
-    cc_free(node);
+    cc_free_with(data->allocator, node);
 }
 
 static void value_destructor_many(void *ptr, void *meta) {
     ccbucket_value_t *value = ptr;
     struct destructor_data *data = meta;
     if(data->destructor) data->destructor(value->value, data->user_data);
-    cc_free(value);
+    cc_free_with(data->allocator, value);
 }
 
 static void node_destructor_many(void *ptr, void *meta) {
     ccbucket_node_t *node = ptr;
     struct destructor_data *data = meta;
     cclist_clear(&node->many_values, value_destructor_many, data);
-    cc_free(node);
+    cc_free_with(data->allocator, node);
 }
 
 void cctable_deinit(cctable_t *table, cc_destructor des, void *ptr) {
     CCASSERT(table);
 
     struct destructor_data data;
+    data.allocator = &table->allocator;
     data.destructor = des;
     data.user_data = ptr;
 
@@ -86,7 +83,7 @@ void cctable_deinit(cctable_t *table, cc_destructor des, void *ptr) {
     for(size_t i = 0; i < table->capacity; ++i) {
         cclist_clear(&table->buckets[i], node_destructor, &data);
     }
-    cc_free(table->buckets);
+    cc_free_with(&table->allocator, table->buckets);
     table->capacity = 0;
     table->size = 0;
     table->buckets = NULL;
@@ -101,7 +98,8 @@ static void cctable_insert_single(cctable_t *table, const char *key, void *objec
         if(!strcmp(key, node->key)) return;
     }
 
-    ccbucket_node_t *new_node = cc_alloc(sizeof(ccbucket_node_t) + key_length + 1);
+    ccbucket_node_t *new_node = cc_alloc_with(&table->allocator,
+                                              sizeof(ccbucket_node_t) + key_length + 1);
 
     memcpy(new_node->key, key, key_length);
     new_node->key[key_length] = 0;
@@ -110,8 +108,8 @@ static void cctable_insert_single(cctable_t *table, const char *key, void *objec
     table->size += 1;
 }
 
-ccbucket_value_t *value_many_new(void *object) {
-    ccbucket_value_t *value = cc_alloc(sizeof(ccbucket_value_t));
+static ccbucket_value_t *value_many_new(cctable_t *table, void *object) {
+    ccbucket_value_t *value = cc_alloc_with(&table->allocator, sizeof(ccbucket_value_t));
     value->value = object;
     return value;
 }
@@ -124,17 +122,18 @@ static void cctable_insert_many(cctable_t *table, const char *key, void *object)
     for(ccbucket_node_t *node = cclist_first(bucket); node; node = cclist_next(bucket, node)) {
         if(strcmp(key, node->key)) continue;
         table->size += 1;
-        return cclist_insert_first(&node->many_values, value_many_new(object));
+        return cclist_insert_first(&node->many_values, value_many_new(table, object));
     }
 
-    ccbucket_node_t *new_node = cc_alloc(sizeof(ccbucket_node_t) + key_length + 1);
+    ccbucket_node_t *new_node = cc_alloc_with(&table->allocator,
+                                              sizeof(ccbucket_node_t) + key_length + 1);
 
     memcpy(new_node->key, key, key_length);
     new_node->key[key_length] = 0;
     cclist_init(&new_node->many_values);
     cclist_insert_first(bucket, new_node);
     table->size += 1;
-    cclist_insert_first(&new_node->many_values, value_many_new(object));
+    cclist_insert_first(&new_node->many_values, value_many_new(table, object));
 }
 
 void cctable_insert(cctable_t *table, const char *key, void *object) {
@@ -9,100 +9,487 @@
 #include "tpool.h"
 #include <ccore/memory.h>
 #include <ccore/log.h>
+#include <sched.h>
+#include <string.h>
+
+#define DEQUE_INITIAL_SIZE (256)
+#define IDLE_SPINS (64)
 
 static tpool_t *pool = NULL;
 static pthread_mutex_t single_mt = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local worker_t *current_worker = NULL;
 
-static void *pool_worker(void *refcon) {
-    tpool_t *pool = refcon;
-    CCASSERT(pool);
+// MARK: - Task slab
+
+static task_t *slab_get(tpool_t *pool, uint32_t index) {
+    CCASSERT(index);
+    uint32_t i = index - 1;
+    task_t *chunk = atomic_load_explicit(&pool->slab.chunks[i / TASK_CHUNK_SIZE], memory_order_acquire);
+    return &chunk[i % TASK_CHUNK_SIZE];
+}
+
+static void slab_push(tpool_t *pool, task_t *task) {
+    uint64_t head = atomic_load_explicit(&pool->slab.free_head, memory_order_relaxed);
+    uint64_t next;
+    do {
+        atomic_store_explicit(&task->next, (uint32_t)head, memory_order_relaxed);
+        next = (((head >> 32) + 1) << 32) | task->index;
+    } while(!atomic_compare_exchange_weak_explicit(&pool->slab.free_head, &head, next,
+                                                   memory_order_release, memory_order_relaxed));
+}
+
+static bool slab_grow(tpool_t *pool) {
+    pthread_mutex_lock(&pool->slab.grow_mt);
+    // Somebody might have grown the slab, or returned tasks, while we were waiting.
+    if((uint32_t)atomic_load(&pool->slab.free_head)) {
+        pthread_mutex_unlock(&pool->slab.grow_mt);
+        return true;
+    }
+
+    uint32_t count = atomic_load_explicit(&pool->slab.chunk_count, memory_order_relaxed);
+    if(count == TASK_MAX_CHUNKS) {
+        pthread_mutex_unlock(&pool->slab.grow_mt);
+        return false;
+    }
+
+    task_t *chunk = cc_alloc(TASK_CHUNK_SIZE * sizeof(task_t));
+    for(uint32_t i = 0; i < TASK_CHUNK_SIZE; ++i) {
+        chunk[i].fn = NULL;
+        chunk[i].refcon = NULL;
+        chunk[i].index = count * TASK_CHUNK_SIZE + i + 1;
+        atomic_init(&chunk[i].next, 0);
+    }
+    atomic_store_explicit(&pool->slab.chunks[count], chunk, memory_order_release);
+    atomic_store_explicit(&pool->slab.chunk_count, count + 1, memory_order_relaxed);
+
+    for(uint32_t i = TASK_CHUNK_SIZE; i > 0; --i) slab_push(pool, &chunk[i - 1]);
+    pthread_mutex_unlock(&pool->slab.grow_mt);
+    return true;
+}
+
+static task_t *slab_pop(tpool_t *pool) {
+    for(;;) {
+        uint64_t head = atomic_load_explicit(&pool->slab.free_head, memory_order_acquire);
+        uint32_t index = (uint32_t)head;
+        if(!index) {
+            // Out of task slots: the pool is badly backed up, so wait for workers to catch up.
+            if(!slab_grow(pool)) sched_yield();
+            continue;
+        }
+
+        // Chunks are never freed while the pool runs, so reading [next] is safe even if another
+        // thread pops this task first. The tag in the high bits makes our CAS fail if it did.
+        task_t *task = slab_get(pool, index);
+        uint64_t next = atomic_load_explicit(&task->next, memory_order_relaxed);
+        uint64_t new_head = (((head >> 32) + 1) << 32) | next;
+        if(atomic_compare_exchange_weak_explicit(&pool->slab.free_head, &head, new_head,
+                                                 memory_order_acquire, memory_order_relaxed)) {
+            return task;
+        }
+    }
+}
+
+// MARK: - Chase-Lev deque
+// Follows "Correct and Efficient Work-Stealing for Weak Memory Models", Lê et al., PPoPP 2013.
+
+static deque_array_t *deque_array_new(int64_t size) {
+    CCASSERT(size > 0 && !(size & (size - 1)));
+    deque_array_t *array = cc_alloc(sizeof(deque_array_t) + size * sizeof(array->tasks[0]));
+    array->retired = NULL;
+    array->size = size;
+    for(int64_t i = 0; i < size; ++i) atomic_init(&array->tasks[i], NULL);
+    return array;
+}
+
+static void deque_init(deque_t *deque) {
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->array, deque_array_new(DEQUE_INITIAL_SIZE));
+}
+
+static void deque_fini(deque_t *deque) {
+    deque_array_t *array = atomic_load(&deque->array);
+    while(array) {
+        deque_array_t *retired = array->retired;
+        cc_free(array);
+        array = retired;
+    }
+}
+
+static void deque_push(deque_t *deque, task_t *task) {
+    int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    deque_array_t *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+    if(b - t > array->size - 1) {
+        deque_array_t *grown = deque_array_new(array->size * 2);
+        for(int64_t i = t; i < b; ++i) {
+            task_t *moved = atomic_load_explicit(&array->tasks[i & (array->size - 1)], memory_order_relaxed);
+            atomic_store_explicit(&grown->tasks[i & (grown->size - 1)], moved, memory_order_relaxed);
+        }
+        grown->retired = array;
+        atomic_store_explicit(&deque->array, grown, memory_order_release);
+        array = grown;
+    }
+
+    atomic_store_explicit(&array->tasks[b & (array->size - 1)], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+}
+
+static task_t *deque_take(deque_t *deque) {
+    int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    deque_array_t *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if(t > b) {
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    task_t *task = atomic_load_explicit(&array->tasks[b & (array->size - 1)], memory_order_relaxed);
+    if(t == b) {
+        // Last task: race thieves for it.
+        if(!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                    memory_order_seq_cst, memory_order_relaxed)) {
+            task = NULL;
+        }
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+// Returns NULL if the deque is empty, or if another thread won the race, in which case
+// [contended] is set and trying again might succeed.
+static task_t *deque_steal(deque_t *deque, bool *contended) {
+    int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    *contended = false;
+    if(t >= b) return NULL;
+
+    deque_array_t *array = atomic_load_explicit(&deque->array, memory_order_acquire);
+    task_t *task = atomic_load_explicit(&array->tasks[t & (array->size - 1)], memory_order_relaxed);
+    if(!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                memory_order_seq_cst, memory_order_relaxed)) {
+        *contended = true;
+        return NULL;
+    }
+    return task;
+}
+
+static bool deque_is_empty(deque_t *deque) {
+    int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    int64_t b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    return t >= b;
+}
+
+// MARK: - Injection queue
+
+static void inject_init(tpool_t *pool) {
+    for(size_t i = 0; i < INJECT_QUEUE_SIZE; ++i) {
+        atomic_init(&pool->inject.cells[i].seq, i);
+        pool->inject.cells[i].task = NULL;
+    }
+    atomic_init(&pool->inject.head, 0);
+    atomic_init(&pool->inject.tail, 0);
+}
+
+static bool inject_push(tpool_t *pool, task_t *task) {
+    inject_cell_t *cell = NULL;
+    size_t pos = atomic_load_explicit(&pool->inject.tail, memory_order_relaxed);
+
+    for(;;) {
+        cell = &pool->inject.cells[pos & (INJECT_QUEUE_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if(diff == 0) {
+            if(atomic_compare_exchange_weak_explicit(&pool->inject.tail, &pos, pos + 1,
+                                                     memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if(diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&pool->inject.tail, memory_order_relaxed);
+        }
+    }
+
+    cell->task = task;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+static task_t *inject_pop(tpool_t *pool) {
+    inject_cell_t *cell = NULL;
+    size_t pos = atomic_load_explicit(&pool->inject.head, memory_order_relaxed);
 
     for(;;) {
-        pthread_mutex_lock(&pool->mt);
-        while(!pool->tasks.size && !pool->stop) pthread_cond_wait(&pool->cv, &pool->mt);
-        if(pool->stop) {
-            pthread_mutex_unlock(&pool->mt);
-            break;
+        cell = &pool->inject.cells[pos & (INJECT_QUEUE_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if(diff == 0) {
+            if(atomic_compare_exchange_weak_explicit(&pool->inject.head, &pos, pos + 1,
+                                                     memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if(diff < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&pool->inject.head, memory_order_relaxed);
         }
+    }
+
+    task_t *task = cell->task;
+    atomic_store_explicit(&cell->seq, pos + INJECT_QUEUE_SIZE, memory_order_release);
+    return task;
+}
+
+static bool inject_is_empty(tpool_t *pool) {
+    size_t head = atomic_load_explicit(&pool->inject.head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&pool->inject.tail, memory_order_acquire);
+    return head == tail;
+}
+
+// MARK: - Workers
+
+static uint32_t next_random(worker_t *self) {
+    uint32_t x = self->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return self->rng = x;
+}
+
+static task_t *find_task(worker_t *self) {
+    tpool_t *pool = self->pool;
+
+    task_t *task = deque_take(&self->deque);
+    if(task) return task;
+
+    task = inject_pop(pool);
+    if(task) return task;
+
+    int count = pool->thread_count;
+    int start = next_random(self) % count;
+    for(int i = 0; i < count; ++i) {
+        worker_t *victim = &pool->workers[(start + i) % count];
+        if(victim == self) continue;
+
+        bool contended = false;
+        do {
+            task = deque_steal(&victim->deque, &contended);
+        } while(!task && contended);
+        if(task) return task;
+    }
+    return NULL;
+}
+
+static bool has_work(tpool_t *pool) {
+    if(!inject_is_empty(pool)) return true;
+    for(int i = 0; i < pool->thread_count; ++i) {
+        if(!deque_is_empty(&pool->workers[i].deque)) return true;
+    }
+    return false;
+}
+
+static void run_task(tpool_t *pool, task_t *task) {
+    CCASSERT(task->fn);
+    ccpool_task_t fn = task->fn;
+    void *refcon = task->refcon;
+    slab_push(pool, task);
+
+    fn(refcon);
+
+    if(atomic_fetch_sub(&pool->pending, 1) == 1) {
+        pthread_mutex_lock(&pool->idle_mt);
+        pthread_cond_broadcast(&pool->idle_cv);
+        pthread_mutex_unlock(&pool->idle_mt);
+    }
+}
+
+// Submitters bump the epoch whenever they find sleepers. Incrementing [sleepers] before checking
+// for work one last time, with submitters publishing work before reading [sleepers], means one of
+// the two always sees the other, so a wakeup can't be lost.
+static void park(worker_t *self) {
+    tpool_t *pool = self->pool;
+
+    pthread_mutex_lock(&pool->sleep_mt);
+    uint64_t epoch = pool->wake_epoch;
+    pthread_mutex_unlock(&pool->sleep_mt);
 
-        task_t *task = cclist_first(&pool->tasks);
-        cclist_remove_first(&pool->tasks);
+    atomic_fetch_add(&pool->sleepers, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if(!has_work(pool) && !atomic_load(&pool->stop)) {
+        pthread_mutex_lock(&pool->sleep_mt);
+        while(pool->wake_epoch == epoch && !atomic_load(&pool->stop)) {
+            pthread_cond_wait(&pool->sleep_cv, &pool->sleep_mt);
+        }
+        pthread_mutex_unlock(&pool->sleep_mt);
+    }
+    atomic_fetch_sub(&pool->sleepers, 1);
+}
 
-        pool->in_work += 1;
-        pthread_mutex_unlock(&pool->mt);
+static void wake(tpool_t *pool, size_t count) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if(!atomic_load(&pool->sleepers)) return;
 
-        CCASSERT(task);
-        CCASSERT(task->fn);
+    pthread_mutex_lock(&pool->sleep_mt);
+    pool->wake_epoch += 1;
+    if(count > 1) {
+        pthread_cond_broadcast(&pool->sleep_cv);
+    } else {
+        pthread_cond_signal(&pool->sleep_cv);
+    }
+    pthread_mutex_unlock(&pool->sleep_mt);
+}
 
-        task->fn(task->refcon);
-        cc_free(task);
+static void *pool_worker(void *refcon) {
+    worker_t *self = refcon;
+    CCASSERT(self);
+    tpool_t *pool = self->pool;
+    current_worker = self;
 
-        pthread_mutex_lock(&pool->mt);
-        pool->in_work -= 1;
-        pthread_cond_signal(&pool->idle_cv);
-        pthread_mutex_unlock(&pool->mt);
+    int spins = 0;
+    while(!atomic_load_explicit(&pool->stop, memory_order_acquire)) {
+        task_t *task = find_task(self);
+        if(task) {
+            run_task(pool, task);
+            spins = 0;
+        } else if(spins < IDLE_SPINS) {
+            spins += 1;
+            sched_yield();
+        } else {
+            park(self);
+            spins = 0;
+        }
     }
+
+    current_worker = NULL;
     return NULL;
 }
 
+// MARK: - Public API
+
 void ccpool_start(int num_threads) {
+    CCASSERT(num_threads > 0);
     pthread_mutex_lock(&single_mt);
     if(!pool) {
-        pool = cc_alloc(sizeof(tpool_t) + num_threads * sizeof(pthread_t));
+        pool = cc_alloc(sizeof(tpool_t) + num_threads * sizeof(worker_t));
+        memset(pool, 0, sizeof(tpool_t));
         pool->thread_count = num_threads;
-        pool->stop = false;
-        pool->in_work = 0;
-        cclist_init(&pool->tasks);
-        pthread_mutex_init(&pool->mt, NULL);
-        pthread_cond_init(&pool->cv, NULL);
+        atomic_init(&pool->stop, false);
+
+        atomic_init(&pool->slab.free_head, 0);
+        atomic_init(&pool->slab.chunk_count, 0);
+        for(int i = 0; i < TASK_MAX_CHUNKS; ++i) atomic_init(&pool->slab.chunks[i], NULL);
+        pthread_mutex_init(&pool->slab.grow_mt, NULL);
+
+        inject_init(pool);
+
+        atomic_init(&pool->sleepers, 0);
+        pool->wake_epoch = 0;
+        pthread_mutex_init(&pool->sleep_mt, NULL);
+        pthread_cond_init(&pool->sleep_cv, NULL);
+
+        atomic_init(&pool->pending, 0);
+        pthread_mutex_init(&pool->idle_mt, NULL);
         pthread_cond_init(&pool->idle_cv, NULL);
 
         for(int i = 0; i < num_threads; ++i) {
-            pthread_create(&pool->workers[i], NULL, pool_worker, pool);
+            worker_t *worker = &pool->workers[i];
+            worker->pool = pool;
+            worker->index = i;
+            worker->rng = 0x9e3779b9u * (i + 1);
+            deque_init(&worker->deque);
+        }
+        for(int i = 0; i < num_threads; ++i) {
+            pthread_create(&pool->workers[i].thread, NULL, pool_worker, &pool->workers[i]);
         }
     }
     pthread_mutex_unlock(&single_mt);
 }
 
-static void task_destructor(void *task, void *refcon) {
-    CCUNUSED(refcon);
-    cc_free(task);
-}
-
 void ccpool_stop() {
     pthread_mutex_lock(&single_mt);
     if(pool) {
-        pthread_mutex_lock(&pool->mt);
-        pool->stop = true;
-        cclist_clear(&pool->tasks, task_destructor, NULL);
-        pthread_cond_broadcast(&pool->cv);
-        pthread_mutex_unlock(&pool->mt);
-
-        for(uint8_t i = 0; i < pool->thread_count; ++i) {
-            pthread_join(pool->workers[i], NULL);
+        atomic_store(&pool->stop, true);
+        pthread_mutex_lock(&pool->sleep_mt);
+        pool->wake_epoch += 1;
+        pthread_cond_broadcast(&pool->sleep_cv);
+        pthread_mutex_unlock(&pool->sleep_mt);
+
+        for(int i = 0; i < pool->thread_count; ++i) {
+            pthread_join(pool->workers[i].thread, NULL);
+        }
+
+        // Tasks still queued are dropped, and their memory goes away with the slab.
+        for(int i = 0; i < pool->thread_count; ++i) {
+            deque_fini(&pool->workers[i].deque);
+        }
+        uint32_t chunks = atomic_load(&pool->slab.chunk_count);
+        for(uint32_t i = 0; i < chunks; ++i) {
+            cc_free(atomic_load(&pool->slab.chunks[i]));
         }
+
+        pthread_mutex_destroy(&pool->slab.grow_mt);
+        pthread_mutex_destroy(&pool->sleep_mt);
+        pthread_cond_destroy(&pool->sleep_cv);
+        pthread_mutex_destroy(&pool->idle_mt);
+        pthread_cond_destroy(&pool->idle_cv);
         cc_free(pool);
         pool = NULL;
     }
     pthread_mutex_unlock(&single_mt);
 }
 
+// Workers queue follow-up tasks on their own deque, where they'll likely find them still in
+// cache. Everyone else goes through the shared injection queue.
+static void enqueue(tpool_t *pool, task_t *task) {
+    worker_t *self = current_worker;
+    if(self && self->pool == pool) {
+        deque_push(&self->deque, task);
+        return;
+    }
+    while(!inject_push(pool, task)) sched_yield();
+}
+
 void ccpool_submit(ccpool_task_t fn, void *refcon) {
     CCASSERT(fn);
     CCASSERT(pool);
-    task_t *task = cc_alloc(sizeof (task_t));
+    task_t *task = slab_pop(pool);
     task->fn = fn;
     task->refcon = refcon;
 
-    pthread_mutex_lock(&pool->mt);
-    cclist_insert_last(&pool->tasks, task);
-    pthread_cond_signal(&pool->cv);
-    pthread_mutex_unlock(&pool->mt);
+    atomic_fetch_add(&pool->pending, 1);
+    enqueue(pool, task);
+    wake(pool, 1);
+}
+
+void ccpool_submit_batch(const ccpool_job_t *jobs, size_t count) {
+    CCASSERT(pool);
+    CCASSERT(jobs || !count);
+    if(!count) return;
+
+    atomic_fetch_add(&pool->pending, count);
+    for(size_t i = 0; i < count; ++i) {
+        CCASSERT(jobs[i].fn);
+        task_t *task = slab_pop(pool);
+        task->fn = jobs[i].fn;
+        task->refcon = jobs[i].refcon;
+        enqueue(pool, task);
+    }
+    wake(pool, count);
 }
 
 void ccpool_wait() {
     CCASSERT(pool);
-    pthread_mutex_lock(&pool->mt);
-    while(pool->in_work || pool->tasks.size) pthread_cond_wait(&pool->idle_cv, &pool->mt);
-    pthread_mutex_unlock(&pool->mt);
+    pthread_mutex_lock(&pool->idle_mt);
+    while(atomic_load(&pool->pending)) pthread_cond_wait(&pool->idle_cv, &pool->idle_mt);
+    pthread_mutex_unlock(&pool->idle_mt);
 }
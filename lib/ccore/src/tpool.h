@@ -7,28 +7,87 @@
 // =^•.•^=
 //===--------------------------------------------------------------------------------------------===
 #pragma once
-#include <ccore/list.h>
 #include <ccore/tpool.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+// Tasks come out of a slab that only ever grows while the pool runs. They're addressed by index,
+// so the free list head can carry an ABA tag next to the index in a single 64-bit word.
+#define TASK_CHUNK_SIZE (256)
+#define TASK_MAX_CHUNKS (1024)
+
+// Capacity of the queue that non-worker threads submit through. Must be a power of two.
+#define INJECT_QUEUE_SIZE (4096)
+
 typedef struct task_s {
-    cclist_node_t base;
     ccpool_task_t fn;
     void *refcon;
+    uint32_t index;         // 1-based slot in the slab
+    _Atomic uint32_t next;  // next free slot, 0 for none
 } task_t;
 
+// Circular array backing a deque. Old arrays are kept until the pool stops, because a thief may
+// still be reading from one after the owner has grown the deque.
+typedef struct deque_array_s {
+    struct deque_array_s *retired;
+    int64_t size;
+    _Atomic(task_t *) tasks[];
+} deque_array_t;
+
+// Chase-Lev work-stealing deque: the owning worker pushes and takes at the bottom, everyone else
+// steals from the top.
+typedef struct {
+    _Atomic int64_t top;
+    _Atomic int64_t bottom;
+    _Atomic(deque_array_t *) array;
+} deque_t;
+
+// Bounded multi-producer, multi-consumer queue (D. Vyukov's design) for tasks submitted from
+// threads outside the pool.
+typedef struct {
+    _Atomic size_t seq;
+    task_t *task;
+} inject_cell_t;
+
+typedef struct tpool_s tpool_t;
+
+typedef struct {
+    tpool_t *pool;
+    int index;
+    uint32_t rng;
+    pthread_t thread;
+    deque_t deque;
+} worker_t;
+
+struct tpool_s {
+    _Atomic bool stop;
+
+    struct {
+        _Atomic uint64_t free_head;     // (tag << 32) | index
+        _Atomic(task_t *) chunks[TASK_MAX_CHUNKS];
+        _Atomic uint32_t chunk_count;
+        pthread_mutex_t grow_mt;
+    } slab;
+
+    struct {
+        inject_cell_t cells[INJECT_QUEUE_SIZE];
+        _Atomic size_t head;
+        _Atomic size_t tail;
+    } inject;
 
-typedef struct tpool_s {
-    cclist_t tasks;
-    bool stop;
+    // Idle workers park here. Submitters only take the lock when someone is asleep.
+    _Atomic int sleepers;
+    uint64_t wake_epoch;
+    pthread_mutex_t sleep_mt;
+    pthread_cond_t sleep_cv;
 
-    pthread_mutex_t mt;
-    pthread_cond_t cv;
+    // Tasks submitted but not finished yet, for ccpool_wait().
+    _Atomic size_t pending;
+    pthread_mutex_t idle_mt;
     pthread_cond_t idle_cv;
 
-    uint8_t in_work;
-    uint8_t thread_count;
-    pthread_t workers[];
-} tpool_t;
+    int thread_count;
+    worker_t workers[];
+};
@@ -11,7 +11,10 @@
 #include <ccore/memory.h>
 #include <stdio.h>
 
-#define GC_INITIAL_THRESHOLD (128)
+// Collections start once 64KiB have been allocated. After each one, the threshold is set to a
+// multiple of what survived, so the cost of collecting stays proportional to allocation.
+#define GC_INITIAL_THRESHOLD (64 * 1024)
+#define GC_GROWTH_FACTOR (2)
 
 void gc_init(obj_gc_t *gc) {
     CCASSERT(gc);
@@ -19,6 +22,15 @@ void gc_init(obj_gc_t *gc) {
     gc->allocated = 0;
     gc->next_collect = GC_INITIAL_THRESHOLD;
     gc->head = NULL;
+
+    gc->roots = NULL;
+    gc->trace = NULL;
+    gc->user_data = NULL;
+
+    gc->gray = NULL;
+    gc->gray_count = 0;
+    gc->gray_capacity = 0;
+    gc->temp_root_count = 0;
 }
 
 void gc_deinit(obj_gc_t *gc) {
@@ -30,31 +42,100 @@ void gc_deinit(obj_gc_t *gc) {
         obj = obj->next;
         cc_free(to_delete);
     }
-
-    // TODO: follow chain and deallocate
+    cc_free(gc->gray);
     gc_init(gc);
 }
 
+void gc_set_tracer(obj_gc_t *gc, gc_roots_f roots, gc_trace_f trace, void *user_data) {
+    CCASSERT(gc);
+    gc->roots = roots;
+    gc->trace = trace;
+    gc->user_data = user_data;
+}
+
+void gc_mark(obj_gc_t *gc, object_t *obj) {
+    CCASSERT(gc);
+    if(!obj || obj->is_marked == gc->mark_flag) return;
+    obj->is_marked = gc->mark_flag;
+
+    if(gc->gray_count == gc->gray_capacity) {
+        gc->gray_capacity = gc->gray_capacity ? gc->gray_capacity * 2 : 64;
+        gc->gray = cc_realloc(gc->gray, gc->gray_capacity * sizeof(object_t *));
+    }
+    gc->gray[gc->gray_count++] = obj;
+}
+
+void gc_mark_value(obj_gc_t *gc, value_t value) {
+    if(value.kind != VALUE_REF) return;
+    gc_mark(gc, (object_t *)value.ref_val);
+}
+
+void gc_push_root(obj_gc_t *gc, object_t *obj) {
+    CCASSERT(gc);
+    CCASSERT(gc->temp_root_count < GC_MAX_TEMP_ROOTS);
+    gc->temp_roots[gc->temp_root_count++] = obj;
+}
+
+void gc_pop_root(obj_gc_t *gc) {
+    CCASSERT(gc);
+    CCASSERT(gc->temp_root_count > 0);
+    gc->temp_root_count -= 1;
+}
+
+static void gc_trace(obj_gc_t *gc) {
+    // The gray stack is used instead of recursing, so deep graphs can't overflow the C stack.
+    while(gc->gray_count) {
+        object_t *obj = gc->gray[--gc->gray_count];
+        if(gc->trace) gc->trace(gc, obj, gc->user_data);
+    }
+}
+
+static void gc_sweep(obj_gc_t *gc) {
+    object_t **link = &gc->head;
+    while(*link) {
+        object_t *obj = *link;
+        if(obj->is_marked == gc->mark_flag) {
+            link = &obj->next;
+            continue;
+        }
+        *link = obj->next;
+        gc->allocated -= obj->size;
+        cc_free(obj);
+    }
+}
+
 void gc_collect(obj_gc_t *gc) {
-    // First, we be marking!
-    object_t *obj = gc->head;
-    while(obj) {
+    CCASSERT(gc);
 
-        obj = obj->next;
+    for(size_t i = 0; i < gc->temp_root_count; ++i) {
+        gc_mark(gc, gc->temp_roots[i]);
     }
+    if(gc->roots) gc->roots(gc, gc->user_data);
+    gc_trace(gc);
+    gc_sweep(gc);
 
+    // Survivors are marked with the current flag. Flipping it unmarks them all at once, instead
+    // of walking the heap again.
+    gc->mark_flag = !gc->mark_flag;
+
+    size_t next = gc->allocated * GC_GROWTH_FACTOR;
+    gc->next_collect = next > GC_INITIAL_THRESHOLD ? next : GC_INITIAL_THRESHOLD;
 }
 
 void *gc_new(obj_gc_t *gc, size_t size, int kind) {
     CCASSERT(gc);
-    CCASSERT(size > sizeof(object_t));
-    object_t *obj = cc_alloc(size);
+    CCASSERT(size >= sizeof(object_t));
 
-    gc->allocated += 1;
-    if(gc->allocated > gc->next_collect) gc_collect(gc);
+    // Collect before the new object is linked in, so it can't be swept before its caller has
+    // had a chance to reference it.
+    if(gc->allocated + size > gc->next_collect) gc_collect(gc);
+
+    object_t *obj = cc_alloc(size);
+    gc->allocated += size;
 
     obj->is_marked = !gc->mark_flag;
     obj->kind = kind;
+    obj->size = size;
     obj->next = gc->head;
     gc->head = obj;
     return obj;
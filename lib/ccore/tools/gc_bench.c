@@ -0,0 +1,201 @@
+//===--------------------------------------------------------------------------------------------===
+// gc_bench.c - Allocation throughput and pause times of the value heap's collector.
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+// Usage:
+//   ccore-gc-bench          runs every benchmark with the default sizes
+//   ccore-gc-bench <max>    stops both tables at <max> live objects
+//
+// The live set is a forest of binary trees, reachable from the roots callback. Trees are built
+// with gc_new() while the collector runs, so nodes that aren't linked in yet are kept alive with
+// gc_push_root(). Every benchmark then walks the forest to check that nothing live was freed.
+#define _POSIX_C_SOURCE 200809L
+#include <ccore/value.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TREE_DEPTH (10)             // 1023 nodes per tree, well within GC_MAX_TEMP_ROOTS
+#define TREE_NODES ((1 << TREE_DEPTH) - 1)
+#define CHURN_OBJECTS (2000000)
+#define PAUSE_RUNS (5)
+
+typedef struct node_s {
+    object_t obj;
+    struct node_s *left;
+    struct node_s *right;
+    int64_t payload;
+} node_t;
+
+static struct {
+    node_t **trees;
+    size_t tree_count;
+    size_t tree_capacity;
+    uint64_t collections;
+} bench;
+
+static uint64_t now_nsec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void mark_roots(obj_gc_t *gc, void *user_data) {
+    (void)user_data;
+    bench.collections += 1;
+    for(size_t i = 0; i < bench.tree_count; ++i) {
+        gc_mark(gc, &bench.trees[i]->obj);
+    }
+}
+
+static void trace_node(obj_gc_t *gc, object_t *obj, void *user_data) {
+    (void)user_data;
+    node_t *node = (node_t *)obj;
+    if(node->left) gc_mark(gc, &node->left->obj);
+    if(node->right) gc_mark(gc, &node->right->obj);
+}
+
+static node_t *new_node(obj_gc_t *gc, int64_t payload) {
+    node_t *node = gc_new(gc, sizeof(node_t), OBJ_LEG);
+    node->left = node->right = NULL;
+    node->payload = payload;
+    return node;
+}
+
+// Children are allocated while their parent isn't reachable yet, which is what the temporary
+// root stack is for.
+static node_t *build_tree(obj_gc_t *gc, int depth, int64_t *next_payload) {
+    node_t *node = new_node(gc, (*next_payload)++);
+    if(depth <= 1) return node;
+
+    gc_push_root(gc, &node->obj);
+    node->left = build_tree(gc, depth - 1, next_payload);
+    node->right = build_tree(gc, depth - 1, next_payload);
+    gc_pop_root(gc);
+    return node;
+}
+
+static int64_t tree_sum(const node_t *node, size_t *count) {
+    if(!node) return 0;
+    *count += 1;
+    return node->payload + tree_sum(node->left, count) + tree_sum(node->right, count);
+}
+
+static void add_tree(obj_gc_t *gc) {
+    if(bench.tree_count == bench.tree_capacity) {
+        bench.tree_capacity = bench.tree_capacity ? bench.tree_capacity * 2 : 16;
+        bench.trees = realloc(bench.trees, bench.tree_capacity * sizeof(node_t *));
+    }
+    int64_t payload = (int64_t)bench.tree_count * TREE_NODES;
+    node_t *tree = build_tree(gc, TREE_DEPTH, &payload);
+    bench.trees[bench.tree_count++] = tree;
+}
+
+// Payloads are numbered from 0 across the whole forest, so their sum is known in advance.
+static void check_forest() {
+    size_t count = 0;
+    int64_t sum = 0;
+    for(size_t i = 0; i < bench.tree_count; ++i) {
+        sum += tree_sum(bench.trees[i], &count);
+    }
+    int64_t n = (int64_t)bench.tree_count * TREE_NODES;
+    if(count != (size_t)n || sum != n * (n - 1) / 2) {
+        fprintf(stderr, "live objects were freed: %zu of %lld nodes left\n", count, (long long)n);
+        exit(1);
+    }
+}
+
+static void reset(obj_gc_t *gc) {
+    gc_deinit(gc);
+    gc_init(gc);
+    gc_set_tracer(gc, mark_roots, trace_node, NULL);
+    bench.tree_count = 0;
+    bench.collections = 0;
+}
+
+// After a collection, the next one is scheduled at twice what survived, but never below the
+// initial threshold.
+static void check_growth(const obj_gc_t *gc, size_t initial) {
+    size_t expected = gc->allocated * 2 > initial ? gc->allocated * 2 : initial;
+    if(gc->next_collect != expected) {
+        fprintf(stderr, "next collection at %zu bytes, expected %zu\n", gc->next_collect, expected);
+        exit(1);
+    }
+}
+
+static void bench_throughput(obj_gc_t *gc, size_t live_trees) {
+    reset(gc);
+    for(size_t i = 0; i < live_trees; ++i) add_tree(gc);
+    uint64_t built = bench.collections;
+
+    uint64_t start = now_nsec();
+    for(int i = 0; i < CHURN_OBJECTS; ++i) new_node(gc, i);
+    uint64_t elapsed = now_nsec() - start;
+    check_forest();
+
+    printf("%10zu %12.1f %12.1f %12llu %14zu\n",
+           live_trees * TREE_NODES,
+           (double)elapsed / CHURN_OBJECTS,
+           CHURN_OBJECTS / (elapsed * 1e-9) / 1e6,
+           (unsigned long long)(bench.collections - built),
+           gc->next_collect);
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_pause(obj_gc_t *gc, size_t live_trees, size_t initial) {
+    reset(gc);
+    for(size_t i = 0; i < live_trees; ++i) add_tree(gc);
+
+    // Half of the heap is garbage, as it would be halfway through a collection cycle.
+    uint64_t pauses[PAUSE_RUNS];
+    for(int run = 0; run < PAUSE_RUNS; ++run) {
+        for(size_t i = 0; i < live_trees * TREE_NODES; ++i) new_node(gc, 0);
+        uint64_t start = now_nsec();
+        gc_collect(gc);
+        pauses[run] = now_nsec() - start;
+        check_growth(gc, initial);
+    }
+    check_forest();
+    qsort(pauses, PAUSE_RUNS, sizeof(uint64_t), compare_u64);
+
+    printf("%10zu %12.2f %12.2f %12.2f %14.1f\n",
+           live_trees * TREE_NODES,
+           pauses[0] * 1e-6,
+           pauses[PAUSE_RUNS / 2] * 1e-6,
+           pauses[PAUSE_RUNS - 1] * 1e-6,
+           (double)pauses[PAUSE_RUNS / 2] / (live_trees * TREE_NODES));
+}
+
+int main(int argc, const char **argv) {
+    size_t max_live = argc > 1 ? strtoull(argv[1], NULL, 10) : 2000000;
+
+    obj_gc_t gc;
+    gc_init(&gc);
+    size_t initial = gc.next_collect;
+
+    printf("Allocation throughput, %d short-lived objects of %zu bytes\n",
+           CHURN_OBJECTS, sizeof(node_t));
+    printf("%10s %12s %12s %12s %14s\n", "live", "ns/alloc", "Malloc/s", "collections", "next_collect");
+    for(size_t trees = 0; trees * TREE_NODES <= max_live && trees <= 256; trees = trees ? trees * 4 : 1) {
+        bench_throughput(&gc, trees);
+    }
+
+    printf("\ngc_collect() pause time against heap size (live objects, plus as much garbage)\n");
+    printf("%10s %12s %12s %12s %14s\n", "live", "min ms", "median ms", "max ms", "ns/live object");
+    for(size_t trees = 1; trees * TREE_NODES <= max_live; trees *= 4) {
+        bench_pause(&gc, trees, initial);
+    }
+
+    free(bench.trees);
+    gc_deinit(&gc);
+    return 0;
+}
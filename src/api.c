@@ -0,0 +1,135 @@
+//===--------------------------------------------------------------------------------------------===
+// api.c - datarefs and per-frame listeners for other plugins (see include/htrack/api.h)
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include "api.h"
+#include "htrack.h"
+#include <htrack/api.h>
+#include <acfutils/assert.h>
+#include <acfutils/dr.h>
+#include <acfutils/log.h>
+#include <acfutils/time.h>
+#include <string.h>
+
+#define MAX_LISTENERS (16)
+
+static struct {
+    struct {
+        dr_t raw;
+        dr_t filtered;
+        dr_t output;
+        dr_t timing;
+        dr_t state;
+    } dr;
+
+    // What the datarefs read from.
+    float raw[6];
+    float filtered[6];
+    float output[6];
+    float timing[2];
+    int state;
+
+    uint64_t frame;
+    htk_api_listener_t listeners[MAX_LISTENERS];
+    size_t count;
+} api;
+
+void api_init() {
+    memset(&api, 0, sizeof(api));
+    dr_create_vf(&api.dr.raw, api.raw, 6, false, HTK_DR_POSE_RAW);
+    dr_create_vf(&api.dr.filtered, api.filtered, 6, false, HTK_DR_POSE_FILTERED);
+    dr_create_vf(&api.dr.output, api.output, 6, false, HTK_DR_POSE_OUTPUT);
+    dr_create_vf(&api.dr.timing, api.timing, 2, false, HTK_DR_POSE_TIMING);
+    dr_create_i(&api.dr.state, &api.state, false, HTK_DR_STATE);
+}
+
+void api_cleanup() {
+    dr_delete(&api.dr.raw);
+    dr_delete(&api.dr.filtered);
+    dr_delete(&api.dr.output);
+    dr_delete(&api.dr.timing);
+    dr_delete(&api.dr.state);
+    api.count = 0;
+}
+
+static int find_listener(const htk_api_listener_t *listener) {
+    for(size_t i = 0; i < api.count; ++i) {
+        if(api.listeners[i].callback == listener->callback
+           && api.listeners[i].refcon == listener->refcon) return (int)i;
+    }
+    return -1;
+}
+
+static void add_listener(const htk_api_listener_t *listener) {
+    if(!listener || !listener->callback) return;
+    if(listener->version != HTK_API_VERSION) {
+        logMsg("ignoring listener built for API version %u (this is version %d)",
+               listener->version, HTK_API_VERSION);
+        return;
+    }
+    if(find_listener(listener) >= 0) return;
+    if(api.count == MAX_LISTENERS) {
+        logMsg("too many API listeners, ignoring one more");
+        return;
+    }
+    api.listeners[api.count++] = *listener;
+}
+
+static void remove_listener(const htk_api_listener_t *listener) {
+    if(!listener) return;
+    int i = find_listener(listener);
+    if(i < 0) return;
+    api.listeners[i] = api.listeners[--api.count];
+}
+
+bool api_handle_message(intptr_t msg, void *param) {
+    switch(msg) {
+    case HTK_MSG_ADD_LISTENER:
+        add_listener(param);
+        return true;
+    case HTK_MSG_REMOVE_LISTENER:
+        remove_listener(param);
+        return true;
+    default:
+        return false;
+    }
+}
+
+void api_frame(publish_state_t state,
+               uint64_t input_time,
+               const double raw[6],
+               const double filtered[6],
+               const double output[6]) {
+    htk_api_frame_t frame;
+    frame.version = HTK_API_VERSION;
+    frame.flags = 0;
+    if(state.is_enabled) frame.flags |= HTK_API_ENABLED;
+    if(state.is_active) frame.flags |= HTK_API_ACTIVE;
+    if(state.is_local_input) frame.flags |= HTK_API_LOCAL_INPUT;
+    frame.frame = ++api.frame;
+    frame.sample_age = input_time ? (microclock() - input_time) * 1e-6 : 0.0;
+
+    for(int i = 0; i < 6; ++i) {
+        frame.raw[i] = raw[i];
+        frame.filtered[i] = filtered[i];
+        frame.output[i] = output[i];
+        api.raw[i] = raw[i];
+        api.filtered[i] = filtered[i];
+        api.output[i] = output[i];
+    }
+    api.timing[0] = frame.sample_age;
+    api.timing[1] = htk_settings.input_rate;
+    api.state = frame.flags;
+
+    // Listeners may add or remove listeners from their callback, so we go through a copy.
+    htk_api_listener_t listeners[MAX_LISTENERS];
+    size_t count = api.count;
+    memcpy(listeners, api.listeners, count * sizeof(htk_api_listener_t));
+    for(size_t i = 0; i < count; ++i) {
+        listeners[i].callback(&frame, listeners[i].refcon);
+    }
+}
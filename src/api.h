@@ -0,0 +1,37 @@
+//===--------------------------------------------------------------------------------------------===
+// api.h - datarefs and per-frame listeners for other plugins (see include/htrack/api.h)
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include "publish.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Creates the datarefs.
+void api_init();
+
+/// Removes the datarefs, and forgets every listener.
+void api_cleanup();
+
+/// Handles HTK_MSG_* messages. Returns false if [msg] isn't one of them.
+bool api_handle_message(intptr_t msg, void *param);
+
+/// Updates the datarefs, and calls every listener. [input_time] is when [raw] and [filtered] were
+/// received, as a microclock() time. Sim thread only.
+void api_frame(publish_state_t state,
+               uint64_t input_time,
+               const double raw[6],
+               const double filtered[6],
+               const double output[6]);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
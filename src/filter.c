@@ -0,0 +1,135 @@
+//===--------------------------------------------------------------------------------------------===
+// filter.c - adaptive input smoothing, tuned from the tracker's measured noise
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include "filter.h"
+#include "htrack.h"
+#include "pose.h"
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Noise is measured on the difference between consecutive samples. Its short-term variance is
+// compared with the long-term noise estimate: when it's close, the head is still, and the
+// estimate follows it quickly; otherwise the head is moving, and the estimate only creeps up, so
+// a tracker that gets noisier (lighting changes) is still picked up eventually.
+#define FAST_TAU (0.25)
+#define STILL_TAU (2.0)
+#define MOVING_TAU (20.0)
+#define STILL_RATIO (4.0)
+
+// Output jitter aimed for at an input_smooth of 0 (cm or degrees). It shrinks quadratically to
+// nothing as input_smooth goes to 1.
+#define JITTER_TARGET_MAX (0.1)
+#define ALPHA_MIN (0.01)
+
+// Error from the smoothed pose beyond MOTION_START standard deviations of noise is treated as
+// motion: smoothing fades out, and is gone entirely at MOTION_START + MOTION_RAMP.
+#define MOTION_START (3.0)
+#define MOTION_RAMP (3.0)
+
+// Samples further apart than this restart the estimator instead of being differenced.
+#define MAX_DT (0.25)
+
+static struct {
+    bool has_sample;
+    uint64_t last_time;
+    double last_raw[6];
+    double state[6];
+    double fast_var[6];
+    double noise_var[6];
+
+    _Atomic float noise[6];
+} filter;
+
+void filter_reset() {
+    filter.has_sample = false;
+    for(int i = 0; i < 6; ++i) {
+        filter.fast_var[i] = 0.0;
+        filter.noise_var[i] = 0.0;
+        atomic_store(&filter.noise[i], 0.f);
+    }
+}
+
+static inline double ema_rate(double dt, double tau) {
+    return 1.0 - exp(-dt / tau);
+}
+
+static void estimate_noise(int axis, double delta, double dt) {
+    double d2 = delta * delta;
+    double *fast = &filter.fast_var[axis];
+    double *noise = &filter.noise_var[axis];
+
+    *fast += ema_rate(dt, FAST_TAU) * (d2 - *fast);
+    if(*noise == 0.0) {
+        *noise = *fast;
+    } else if(*fast < STILL_RATIO * *noise) {
+        *noise += ema_rate(dt, STILL_TAU) * (*fast - *noise);
+    } else {
+        *noise += ema_rate(dt, MOVING_TAU) * (*fast - *noise);
+    }
+    // The difference of two noisy samples has twice the variance of the noise itself.
+    atomic_store_explicit(&filter.noise[axis], (float)sqrt(*noise / 2.0), memory_order_relaxed);
+}
+
+// An exponential moving average with factor a turns noise of variance s^2 into a^2 / (1 - (1-a)^2)
+// s^2 = a / (2 - a) s^2. Solving for a given the target gives a = 2r / (1 + r), r = (target/s)^2.
+// A target of zero asks for as much smoothing as there is, but motion still cuts through it.
+static double alpha_for(double sigma, double target, double error) {
+    if(sigma <= target) return 1.0;
+
+    double alpha = ALPHA_MIN;
+    if(target > 0.0) {
+        double r = (target / sigma) * (target / sigma);
+        alpha = 2.0 * r / (1.0 + r);
+    }
+
+    double motion = (fabs(error) / sigma - MOTION_START) / MOTION_RAMP;
+    if(motion > alpha) alpha = motion > 1.0 ? 1.0 : motion;
+    return alpha < ALPHA_MIN ? ALPHA_MIN : alpha;
+}
+
+void filter_update(uint64_t time, const double raw[6], double out[6]) {
+    double dt = filter.has_sample ? (time - filter.last_time) * 1e-6 : 0.0;
+    if(!filter.has_sample || dt <= 0.0 || dt > MAX_DT) {
+        for(int i = 0; i < 6; ++i) filter.state[i] = filter.last_raw[i] = raw[i];
+        filter.has_sample = true;
+        filter.last_time = time;
+        for(int i = 0; i < 6; ++i) out[i] = filter.state[i];
+        return;
+    }
+
+    double smooth = htk_settings.input_smooth;
+    double target = JITTER_TARGET_MAX * (1.0 - smooth) * (1.0 - smooth);
+    double alpha[6];
+    double goal[6];
+    for(int i = 0; i < 6; ++i) {
+        double delta = raw[i] - filter.last_raw[i];
+        double error = raw[i] - filter.state[i];
+        if(i >= 3) {
+            if(delta > 180.0) delta -= 360.0;
+            if(delta < -180.0) delta += 360.0;
+            if(error > 180.0) error -= 360.0;
+            if(error < -180.0) error += 360.0;
+        }
+        goal[i] = filter.state[i] + error; // the short way round, for rotations
+        estimate_noise(i, delta, dt);
+        alpha[i] = smooth > 0.f ? alpha_for(sqrt(filter.noise_var[i] / 2.0), target, error) : 1.0;
+        filter.last_raw[i] = raw[i];
+    }
+    filter.last_time = time;
+
+    pose_filter(filter.state, goal, alpha);
+    pose_wrap(filter.state);
+    for(int i = 0; i < 6; ++i) out[i] = filter.state[i];
+}
+
+void filter_noise(float noise[6]) {
+    for(int i = 0; i < 6; ++i) {
+        noise[i] = atomic_load_explicit(&filter.noise[i], memory_order_relaxed);
+    }
+}
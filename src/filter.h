@@ -0,0 +1,31 @@
+//===--------------------------------------------------------------------------------------------===
+// filter.h - adaptive input smoothing, tuned from the tracker's measured noise
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Forgets the noise estimate and the filter state. Server thread only.
+void filter_reset();
+
+/// Feeds the [raw] tracker pose received at [time] (microseconds), and writes the smoothed pose
+/// into [out]. Smoothing is strong enough to bring jitter down to a target set by
+/// htk_settings.input_smooth, but lets motion through once it clearly stands out of the noise.
+/// Server thread only.
+void filter_update(uint64_t time, const double raw[6], double out[6]);
+
+/// Copies the current per-axis noise estimate (standard deviation, in the tracker's units) into
+/// [noise]. Any thread.
+void filter_noise(float noise[6]);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
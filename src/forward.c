@@ -0,0 +1,239 @@
+//===--------------------------------------------------------------------------------------------===
+// forward.c - UDP fan-out of the smoothed tracker pose to other machines
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#if LIN
+#define _GNU_SOURCE // sendmmsg()
+#endif
+#include "forward.h"
+#include <acfutils/assert.h>
+#include <acfutils/log.h>
+
+#if IBM
+
+void forward_start(const char *path) {
+    UNUSED(path);
+}
+
+void forward_stop() {
+}
+
+void forward_push(const double pose[6]) {
+    UNUSED(pose);
+}
+
+size_t forward_count() {
+    return 0;
+}
+
+const char *forward_destination(size_t i) {
+    UNUSED(i);
+    return NULL;
+}
+
+#else
+#include <acfutils/thread.h>
+#include <ccore/log.h>
+#include <ccore/queue.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DESTINATION_LEN (64)
+
+// Poses waiting to be sent. The sender only falls behind when it can't get CPU time; new poses are
+// dropped until it catches up, rather than making the input thread wait.
+#define QUEUE_SIZE (32)
+
+// Poses sent per wake-up. Each one goes to every destination, all in a single sendmmsg().
+#define BATCH_SIZE (8)
+
+#define WAIT_TIMEOUT_MSEC (250)
+
+typedef struct {
+    char name[DESTINATION_LEN];
+    struct sockaddr_in addr;
+} destination_t;
+
+// Poses live in [poses], and the queue only carries their index. There are twice as many slots
+// as the queue holds: the input thread can only get a queue's length ahead of a slot once the
+// sender has popped past it, and the sender is done with each batch before it pops the next.
+static struct {
+    bool is_running;
+    thread_t thread;
+    int socket;
+
+    destination_t destinations[HTK_FORWARD_MAX_DESTINATIONS];
+    size_t count;
+
+    ccspsc_t *queue;
+    uint32_t next;
+    double poses[2 * QUEUE_SIZE][6];
+} fwd;
+
+static bool parse_destination(const char *line, destination_t *out) {
+    char host[DESTINATION_LEN];
+    char port[8];
+    if(sscanf(line, " %63[^: \t\r\n]:%7[0-9]", host, port) != 2) return false;
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    struct addrinfo *info = NULL;
+    int err = getaddrinfo(host, port, &hints, &info);
+    if(err || !info) {
+        logMsg("cannot forward to %s:%s: %s", host, port, gai_strerror(err));
+        return false;
+    }
+    memcpy(&out->addr, info->ai_addr, sizeof(out->addr));
+    freeaddrinfo(info);
+    snprintf(out->name, sizeof(out->name), "%s:%s", host, port);
+    return true;
+}
+
+static void load_destinations(const char *path) {
+    fwd.count = 0;
+    FILE *f = fopen(path, "r");
+    if(!f) return;
+
+    char line[256];
+    while(fgets(line, sizeof(line), f)) {
+        const char *start = line + strspn(line, " \t");
+        if(*start == '#' || *start == '\n' || *start == '\r' || !*start) continue;
+        if(fwd.count == HTK_FORWARD_MAX_DESTINATIONS) {
+            logMsg("forward.txt: only the first %d destinations are used",
+                   HTK_FORWARD_MAX_DESTINATIONS);
+            break;
+        }
+        if(parse_destination(start, &fwd.destinations[fwd.count])) {
+            fwd.count += 1;
+        } else {
+            logMsg("forward.txt: ignoring `%.*s`", (int)strcspn(start, "\r\n"), start);
+        }
+    }
+    fclose(f);
+}
+
+// MARK: - Sender thread
+
+static void send_batch(const ccmsg_t *msgs, size_t count) {
+    struct iovec iov[BATCH_SIZE];
+    for(size_t i = 0; i < count; ++i) {
+        iov[i].iov_base = fwd.poses[msgs[i].u32];
+        iov[i].iov_len = 6 * sizeof(double);
+    }
+
+#if LIN
+    struct mmsghdr hdrs[BATCH_SIZE * HTK_FORWARD_MAX_DESTINATIONS];
+    unsigned total = 0;
+    for(size_t i = 0; i < count; ++i) {
+        for(size_t d = 0; d < fwd.count; ++d) {
+            struct mmsghdr *hdr = &hdrs[total++];
+            memset(hdr, 0, sizeof(*hdr));
+            hdr->msg_hdr.msg_name = &fwd.destinations[d].addr;
+            hdr->msg_hdr.msg_namelen = sizeof(fwd.destinations[d].addr);
+            hdr->msg_hdr.msg_iov = &iov[i];
+            hdr->msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    unsigned sent = 0;
+    while(sent < total) {
+        int n = sendmmsg(fwd.socket, hdrs + sent, total - sent, 0);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            CCERROR("cannot forward pose: %s", strerror(errno));
+            // Skip the packet that failed; one unreachable host shouldn't starve the others.
+            n = 1;
+        }
+        sent += n;
+    }
+#else
+    // No sendmmsg() outside Linux: same packets, one call each.
+    for(size_t i = 0; i < count; ++i) {
+        for(size_t d = 0; d < fwd.count; ++d) {
+            const destination_t *dest = &fwd.destinations[d];
+            if(sendto(fwd.socket, iov[i].iov_base, iov[i].iov_len, 0,
+                      (const struct sockaddr *)&dest->addr, sizeof(dest->addr)) < 0) {
+                CCERROR("cannot forward pose to %s: %s", dest->name, strerror(errno));
+            }
+        }
+    }
+#endif
+}
+
+static void forward_thread(void *data) {
+    UNUSED(data);
+    thread_set_name("headtrack forward");
+
+    ccmsg_t msgs[BATCH_SIZE];
+    while(fwd.is_running) {
+        if(!ccspsc_pop_wait(fwd.queue, &msgs[0], WAIT_TIMEOUT_MSEC)) continue;
+        size_t count = 1 + ccspsc_pop_n(fwd.queue, msgs + 1, BATCH_SIZE - 1);
+        send_batch(msgs, count);
+    }
+}
+
+// MARK: - API
+
+void forward_start(const char *path) {
+    ASSERT(path);
+    ASSERT(!fwd.is_running);
+    load_destinations(path);
+    if(!fwd.count) return;
+
+    fwd.socket = socket(PF_INET, SOCK_DGRAM, 0);
+    if(fwd.socket < 0) {
+        logMsg("cannot forward poses: %s", strerror(errno));
+        fwd.count = 0;
+        return;
+    }
+
+    logMsg("forwarding poses to %zu destination(s)", fwd.count);
+    fwd.queue = ccspsc_new(QUEUE_SIZE);
+    fwd.next = 0;
+    fwd.is_running = true;
+    thread_create(&fwd.thread, forward_thread, NULL);
+}
+
+void forward_stop() {
+    if(!fwd.is_running) return;
+    fwd.is_running = false;
+    thread_join(&fwd.thread);
+    close(fwd.socket);
+    ccspsc_delete(fwd.queue);
+    fwd.queue = NULL;
+    fwd.count = 0;
+}
+
+void forward_push(const double pose[6]) {
+    if(!fwd.queue) return;
+    uint32_t slot = fwd.next % (2 * QUEUE_SIZE);
+    memcpy(fwd.poses[slot], pose, sizeof(fwd.poses[slot]));
+
+    ccmsg_t msg = {.kind = 0};
+    msg.u32 = slot;
+    if(ccspsc_push(fwd.queue, msg)) fwd.next += 1;
+}
+
+size_t forward_count() {
+    return fwd.count;
+}
+
+const char *forward_destination(size_t i) {
+    ASSERT(i < fwd.count);
+    return fwd.destinations[i].name;
+}
+
+#endif
@@ -0,0 +1,38 @@
+//===--------------------------------------------------------------------------------------------===
+// forward.h - UDP fan-out of the smoothed tracker pose to other machines
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Most destinations forward.txt can list.
+#define HTK_FORWARD_MAX_DESTINATIONS (8)
+
+/// Reads `host:port` lines from [path], and if there are any, starts the thread that sends every
+/// pose to them as OpenTrack packets. Other HeadTrack installs receiving them should turn input
+/// smoothing off, since the poses are already smoothed. Not available on Windows.
+void forward_start(const char *path);
+
+/// Stops the thread. No input thread may be running anymore.
+void forward_stop();
+
+/// Queues [pose] for every destination. Never blocks. Input thread only.
+void forward_push(const double pose[6]);
+
+/// Number of destinations poses are sent to.
+size_t forward_count();
+
+/// Destination [i], as written in forward.txt.
+const char *forward_destination(size_t i);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
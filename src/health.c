@@ -0,0 +1,166 @@
+//===--------------------------------------------------------------------------------------------===
+// health.c - tracker packet timing statistics
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include "health.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define BURST_USEC (2000)
+#define FIRST_BUCKET_USEC (2000)
+#define FIRST_DELAY_BUCKET_USEC (16)
+
+// Statistics with fewer delays than this aren't worth comparing against. Changes made in quick
+// succession all keep the baseline from before the first of them.
+#define BASELINE_MIN_DELAYS (100)
+
+// Only the server thread writes the counters, so plain relaxed stores are enough; readers may
+// see one counter a packet ahead of another, which doesn't matter for display.
+static struct {
+    _Atomic bool reset_requested;
+
+    bool has_packet;
+    bool in_burst;
+    uint64_t first_time;
+    uint64_t last_time;
+
+    _Atomic uint64_t packets;
+    _Atomic uint64_t bursts;
+    _Atomic uint64_t longest_gap;
+    _Atomic uint64_t elapsed;
+    _Atomic uint64_t buckets[HTK_HEALTH_BUCKETS];
+
+    _Atomic uint64_t delays;
+    _Atomic uint64_t delay_total;
+    _Atomic uint64_t delay_max;
+    _Atomic uint64_t delay_buckets[HTK_HEALTH_DELAY_BUCKETS];
+
+    bool has_baseline;
+    htk_health_t baseline;
+} health;
+
+static inline void bump(_Atomic uint64_t *counter) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+}
+
+static void clear() {
+    health.has_packet = false;
+    health.in_burst = false;
+    atomic_store_explicit(&health.packets, 0, memory_order_relaxed);
+    atomic_store_explicit(&health.bursts, 0, memory_order_relaxed);
+    atomic_store_explicit(&health.longest_gap, 0, memory_order_relaxed);
+    atomic_store_explicit(&health.elapsed, 0, memory_order_relaxed);
+    for(int i = 0; i < HTK_HEALTH_BUCKETS; ++i) {
+        atomic_store_explicit(&health.buckets[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&health.delays, 0, memory_order_relaxed);
+    atomic_store_explicit(&health.delay_total, 0, memory_order_relaxed);
+    atomic_store_explicit(&health.delay_max, 0, memory_order_relaxed);
+    for(int i = 0; i < HTK_HEALTH_DELAY_BUCKETS; ++i) {
+        atomic_store_explicit(&health.delay_buckets[i], 0, memory_order_relaxed);
+    }
+}
+
+static int bucket_for(uint64_t value, uint64_t first_limit, int count) {
+    int bucket = 0;
+    for(uint64_t limit = first_limit; value >= limit && bucket < count - 1; limit <<= 1) {
+        bucket += 1;
+    }
+    return bucket;
+}
+
+void health_record(uint64_t time) {
+    if(atomic_exchange_explicit(&health.reset_requested, false, memory_order_acquire)) clear();
+
+    bump(&health.packets);
+    if(!health.has_packet) {
+        health.has_packet = true;
+        health.first_time = health.last_time = time;
+        return;
+    }
+
+    uint64_t gap = time > health.last_time ? time - health.last_time : 0;
+    health.last_time = time;
+    atomic_store_explicit(&health.elapsed, time - health.first_time, memory_order_relaxed);
+    bump(&health.buckets[bucket_for(gap, FIRST_BUCKET_USEC, HTK_HEALTH_BUCKETS)]);
+
+    if(gap > atomic_load_explicit(&health.longest_gap, memory_order_relaxed)) {
+        atomic_store_explicit(&health.longest_gap, gap, memory_order_relaxed);
+    }
+
+    bool is_burst = gap < BURST_USEC;
+    if(is_burst && !health.in_burst) bump(&health.bursts);
+    health.in_burst = is_burst;
+}
+
+void health_record_delay(uint64_t delay) {
+    bump(&health.delays);
+    atomic_store_explicit(&health.delay_total,
+        atomic_load_explicit(&health.delay_total, memory_order_relaxed) + delay, memory_order_relaxed);
+    if(delay > atomic_load_explicit(&health.delay_max, memory_order_relaxed)) {
+        atomic_store_explicit(&health.delay_max, delay, memory_order_relaxed);
+    }
+    bump(&health.delay_buckets[bucket_for(delay, FIRST_DELAY_BUCKET_USEC, HTK_HEALTH_DELAY_BUCKETS)]);
+}
+
+void health_reset() {
+    atomic_store_explicit(&health.reset_requested, true, memory_order_release);
+}
+
+void health_read(htk_health_t *out) {
+    memset(out, 0, sizeof(*out));
+    if(atomic_load_explicit(&health.reset_requested, memory_order_acquire)) return;
+
+    out->packets = atomic_load_explicit(&health.packets, memory_order_relaxed);
+    out->bursts = atomic_load_explicit(&health.bursts, memory_order_relaxed);
+    out->longest_gap = atomic_load_explicit(&health.longest_gap, memory_order_relaxed);
+    out->elapsed = atomic_load_explicit(&health.elapsed, memory_order_relaxed);
+    for(int i = 0; i < HTK_HEALTH_BUCKETS; ++i) {
+        out->buckets[i] = atomic_load_explicit(&health.buckets[i], memory_order_relaxed);
+    }
+    out->delays = atomic_load_explicit(&health.delays, memory_order_relaxed);
+    out->delay_total = atomic_load_explicit(&health.delay_total, memory_order_relaxed);
+    out->delay_max = atomic_load_explicit(&health.delay_max, memory_order_relaxed);
+    for(int i = 0; i < HTK_HEALTH_DELAY_BUCKETS; ++i) {
+        out->delay_buckets[i] = atomic_load_explicit(&health.delay_buckets[i], memory_order_relaxed);
+    }
+}
+
+void health_save_baseline() {
+    htk_health_t current;
+    health_read(&current);
+    if(current.delays >= BASELINE_MIN_DELAYS) {
+        health.baseline = current;
+        health.has_baseline = true;
+    }
+    health_reset();
+}
+
+bool health_read_baseline(htk_health_t *out) {
+    if(health.has_baseline) *out = health.baseline;
+    return health.has_baseline;
+}
+
+float health_bucket_limit(int i) {
+    return (float)(FIRST_BUCKET_USEC << i) / 1000.f;
+}
+
+float health_delay_limit(int i) {
+    return (float)(FIRST_DELAY_BUCKET_USEC << i);
+}
+
+uint64_t health_delay_percentile(const htk_health_t *h, double fraction) {
+    uint64_t target = (uint64_t)(fraction * h->delays);
+    uint64_t seen = 0;
+    for(int i = 0; i < HTK_HEALTH_DELAY_BUCKETS - 1; ++i) {
+        seen += h->delay_buckets[i];
+        if(seen > target) return FIRST_DELAY_BUCKET_USEC << i;
+    }
+    return h->delay_max;
+}
@@ -0,0 +1,73 @@
+//===--------------------------------------------------------------------------------------------===
+// health.h - tracker packet timing statistics
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Inter-arrival times are counted in power-of-two buckets: under 2ms, then [2, 4), [4, 8)...
+/// up to 512ms and over.
+#define HTK_HEALTH_BUCKETS (10)
+
+/// Wake-up delays are counted the same way, from under 16us to 4ms and over.
+#define HTK_HEALTH_DELAY_BUCKETS (10)
+
+typedef struct {
+    uint64_t packets;
+    uint64_t bursts;        // runs of packets less than 2ms apart, usually Wi-Fi buffering
+    uint64_t longest_gap;   // microseconds
+    uint64_t elapsed;       // microseconds between the first and last packet
+    uint64_t buckets[HTK_HEALTH_BUCKETS];
+
+    // Time from a packet arriving (kernel timestamp, or the shared-memory writer's) to the
+    // receive thread handling it, in microseconds.
+    uint64_t delays;
+    uint64_t delay_total;
+    uint64_t delay_max;
+    uint64_t delay_buckets[HTK_HEALTH_DELAY_BUCKETS];
+} htk_health_t;
+
+/// Records a packet that arrived at [time] (microseconds). Server thread only.
+void health_record(uint64_t time);
+
+/// Records how long the packet recorded last waited before the server thread woke up to it
+/// ([delay], microseconds). Server thread only.
+void health_record_delay(uint64_t delay);
+
+/// Asks for the statistics to be cleared. They read as empty from now on, and the server thread
+/// clears them for real when the next packet comes in. Any thread.
+void health_reset();
+
+/// Copies the current statistics into [out]. Any thread.
+void health_read(htk_health_t *out);
+
+/// Keeps the current statistics as a baseline to compare against, and resets them. Used when
+/// the receive thread's scheduling changes. If too few delays were measured since the last call,
+/// the previous baseline is kept instead. Sim thread only.
+void health_save_baseline();
+
+/// Copies the baseline into [out]. Returns false if there isn't one. Sim thread only.
+bool health_read_baseline(htk_health_t *out);
+
+/// Upper bound of histogram bucket [i], in milliseconds. The last bucket has no upper bound.
+float health_bucket_limit(int i);
+
+/// Upper bound of wake-up delay bucket [i], in microseconds. The last bucket has no upper bound.
+float health_delay_limit(int i);
+
+/// Wake-up delay under which a [fraction] of packets were handled, rounded up to a bucket limit
+/// (microseconds). Returns 0 with no measurements, and the largest delay past the last bucket.
+uint64_t health_delay_percentile(const htk_health_t *health, double fraction);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,145 @@
+//===--------------------------------------------------------------------------------------------===
+// history.c - time-stamped pose history with min/max decimation for the scope view
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include "history.h"
+#include <acfutils/assert.h>
+
+#include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+
+// Samples are aggregated into min/max buckets as they come in, at several resolutions. The
+// coarsest level whose buckets are still narrower than a screen column is used when drawing,
+// so the number of buckets visited is bounded by the plot width, no matter the tracker rate.
+#define LEVEL_COUNT (5)
+#define LEVEL_FACTOR (4)
+#define BASE_BUCKET_USEC (4000)
+#define BASE_RING_SIZE (8192) // 8192 * 4ms = 32.7s
+
+typedef struct {
+    uint64_t index; // time / bucket duration
+    float min[6];
+    float max[6];
+} bucket_t;
+
+typedef struct {
+    uint64_t duration;
+    size_t mask;
+    bucket_t *ring;
+    atomic_uint_fast64_t count; // number of committed buckets, published by the writer
+
+    bool has_current;
+    bucket_t current; // only ever touched by the writer
+} level_t;
+
+typedef struct {
+    level_t levels[LEVEL_COUNT];
+} history_t;
+
+static bucket_t ring_storage[HTK_HISTORY_COUNT][BASE_RING_SIZE * 2];
+static history_t histories[HTK_HISTORY_COUNT];
+
+void history_init() {
+    for(int h = 0; h < HTK_HISTORY_COUNT; ++h) {
+        bucket_t *storage = ring_storage[h];
+        uint64_t duration = BASE_BUCKET_USEC;
+        size_t size = BASE_RING_SIZE;
+
+        for(int l = 0; l < LEVEL_COUNT; ++l) {
+            level_t *level = &histories[h].levels[l];
+            level->duration = duration;
+            level->mask = size - 1;
+            level->ring = storage;
+            level->has_current = false;
+            atomic_store(&level->count, 0);
+
+            storage += size;
+            duration *= LEVEL_FACTOR;
+            size /= LEVEL_FACTOR;
+        }
+        ASSERT(storage <= ring_storage[h] + BASE_RING_SIZE * 2);
+    }
+}
+
+static void level_push(level_t *level, uint64_t time, const double pose[6]) {
+    uint64_t index = time / level->duration;
+    bucket_t *cur = &level->current;
+
+    if(level->has_current && cur->index == index) {
+        for(int i = 0; i < 6; ++i) {
+            if(pose[i] < cur->min[i]) cur->min[i] = pose[i];
+            if(pose[i] > cur->max[i]) cur->max[i] = pose[i];
+        }
+        return;
+    }
+
+    if(level->has_current) {
+        uint64_t count = atomic_load_explicit(&level->count, memory_order_relaxed);
+        level->ring[count & level->mask] = *cur;
+        atomic_store_explicit(&level->count, count + 1, memory_order_release);
+    }
+
+    cur->index = index;
+    for(int i = 0; i < 6; ++i) {
+        cur->min[i] = cur->max[i] = pose[i];
+    }
+    level->has_current = true;
+}
+
+void history_push(htk_history_id_t id, uint64_t time, const double pose[6]) {
+    ASSERT(id < HTK_HISTORY_COUNT);
+    for(int l = 0; l < LEVEL_COUNT; ++l) {
+        level_push(&histories[id].levels[l], time, pose);
+    }
+}
+
+void history_decimate(htk_history_id_t id, int axis, uint64_t t0, uint64_t t1,
+                      int columns, float *min, float *max) {
+    ASSERT(id < HTK_HISTORY_COUNT);
+    ASSERT(axis >= 0 && axis < 6);
+    ASSERT(min && max);
+
+    for(int c = 0; c < columns; ++c) {
+        min[c] = max[c] = NAN;
+    }
+    if(columns <= 0 || t1 <= t0) return;
+
+    uint64_t column_duration = (t1 - t0) / columns;
+    if(!column_duration) column_duration = 1;
+
+    const level_t *level = &histories[id].levels[0];
+    for(int l = 1; l < LEVEL_COUNT; ++l) {
+        if(histories[id].levels[l].duration > column_duration) break;
+        level = &histories[id].levels[l];
+    }
+
+    // The writer only ever touches the slot after [count], so as long as we stay one short of a
+    // full ring, everything we read is stable -- unless the writer laps us while we're reading.
+    // Each bucket is copied, then checked against a fresh [count]: once the writer could have
+    // started reusing its slot, it and everything older are dropped.
+    uint64_t count = atomic_load_explicit(&level->count, memory_order_acquire);
+    uint64_t available = count < level->mask ? count : level->mask;
+
+    for(uint64_t i = 0; i < available; ++i) {
+        uint64_t position = count - 1 - i;
+        bucket_t b = level->ring[position & level->mask];
+        atomic_thread_fence(memory_order_acquire);
+        uint64_t written = atomic_load_explicit(&level->count, memory_order_relaxed);
+        if(position + level->mask < written) break;
+
+        uint64_t start = b.index * level->duration;
+        if(start >= t1) continue;
+        if(start < t0) break;
+
+        int c = (int)((start - t0) / column_duration);
+        if(c >= columns) c = columns - 1;
+
+        if(isnan(min[c]) || b.min[axis] < min[c]) min[c] = b.min[axis];
+        if(isnan(max[c]) || b.max[axis] > max[c]) max[c] = b.max[axis];
+    }
+}
@@ -0,0 +1,41 @@
+//===--------------------------------------------------------------------------------------------===
+// history.h - time-stamped pose history with min/max decimation for the scope view
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// How far back in time the history goes, in seconds.
+#define HTK_HISTORY_SECONDS (30)
+
+typedef enum {
+    HTK_HISTORY_INPUT,  // pose received from the tracker, written by the server thread
+    HTK_HISTORY_OUTPUT, // pose sent to the sim, written by the sim thread
+    HTK_HISTORY_COUNT
+} htk_history_id_t;
+
+/// Clears all recorded history.
+void history_init();
+
+/// Records [pose] at [time] (microseconds). Each history must only ever have one writer thread.
+void history_push(htk_history_id_t id, uint64_t time, const double pose[6]);
+
+/// Fills [columns] min/max pairs for [axis], each covering an equal slice of [t0, t1). Columns
+/// that don't contain any sample are set to NaN. Cost is bounded by [columns], not by the
+/// number of samples recorded in that time span.
+void history_decimate(htk_history_id_t id, int axis, uint64_t t0, uint64_t t1,
+                      int columns, float *min, float *max);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
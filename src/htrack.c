@@ -8,13 +8,30 @@
 //===--------------------------------------------------------------------------------------------===
 #include "htrack.h"
 #include "server.h"
-#include "math.h"
+#include "forward.h"
+#include "paths.h"
+#include "local.h"
+#include "health.h"
+#include "history.h"
+#include "input.h"
+#include "profiles.h"
+#include "worker.h"
+#include "pipeline.h"
+#include "pose.h"
+#include "publish.h"
+#include "priority.h"
+#include "api.h"
 
 #include <XPLMGraphics.h>
 #include <XPLMMenus.h>
+#include <XPLMUtilities.h>
 #include <acfutils/assert.h>
 #include <acfutils/dr.h>
+#include <acfutils/helpers.h>
 #include <acfutils/log.h>
+#include <acfutils/time.h>
+#include <ccore/log.h>
+#include <ccore/queue.h>
 
 #include <stdbool.h>
 #include <stdlib.h>
@@ -26,10 +43,14 @@ struct {
     bool is_enabled;
     bool has_headshake;
     bool must_reset;
-    bool plane_spec;
+    bool is_started;
+    // What the running input thread was started with, which can lag behind the settings.
+    bool input_local;
+    bool rx_realtime;
+    int rx_cpu;
 
     double viewport_ref[3];
-    double head_in[6]; // reported by UDP
+    double head_in[6]; // smoothed by the UDP thread, which owns it
     double head[6]; // What we send to x-plane
     double neutral[6];
 
@@ -55,6 +76,7 @@ struct {
         XPLMCommandRef toggle;
         XPLMCommandRef center_head_tracking;
         XPLMCommandRef center_sim_view;
+        XPLMCommandRef reset_stats;
     } cmd;
 
     struct {
@@ -66,21 +88,37 @@ struct {
 } state;
 
 htk_settings_t htk_settings;
+static ccmpsc_t *events = NULL;
+
+#define EVENT_QUEUE_SIZE (256)
+#define EVENT_BATCH (32)
 
 const char *htk_cmd_toggle = "amyinorbit/htrack/toggle";
 const char *htk_cmd_center_head = "amyinorbit/htrack/center_head";
 const char *htk_cmd_center_sim = "amyinorbit/htrack/center_sim";
+const char *htk_cmd_reset_stats = "amyinorbit/htrack/reset_stats";
 
 
 void htk_setup() {
     htk_settings.last_error = NULL;
+    htk_settings.input_rate = 0.f;
+    // Other threads log through ccore, which queues messages until the next frame instead of
+    // writing to Log.txt from wherever they are.
+    cc_set_log_name("headtrack");
+    cc_set_printer(XPLMDebugString);
+    cc_log_set_async(true);
+    events = ccmpsc_new(EVENT_QUEUE_SIZE);
+    pose_init(false);
+    history_init();
+    worker_start();
+    settings_watch_start();
+    settings_load_profiles();
     settings_load_global();
     // htk_settings = defaults;
 
     state.is_enabled = false;
     state.has_headshake = false;
     state.must_reset = true;
-    state.plane_spec = false;
 
     state.cmd.toggle = XPLMCreateCommand(htk_cmd_toggle, "toggle head tracking");
     ASSERT(state.cmd.toggle);
@@ -88,6 +126,8 @@ void htk_setup() {
     ASSERT(state.cmd.center_head_tracking);
     state.cmd.center_sim_view = XPLMCreateCommand(htk_cmd_center_sim, "recenter sim view");
     ASSERT(state.cmd.center_sim_view);
+    state.cmd.reset_stats = XPLMCreateCommand(htk_cmd_reset_stats, "reset tracker health statistics");
+    ASSERT(state.cmd.reset_stats);
 
     logMsg("Setting up datarefs");
 
@@ -104,6 +144,8 @@ void htk_setup() {
     fdr_find(&state.dr.head_y, "sim/graphics/view/pilots_head_y");
     fdr_find(&state.dr.head_z, "sim/graphics/view/pilots_head_z");
 
+    api_init();
+
     state.menu.id = 0;
     state.menu.enabled = -1;
     state.menu.home = -1;
@@ -130,13 +172,17 @@ static int toggle_cb(XPLMCommandRef cmd, XPLMCommandPhase phase, void *refcon) {
     return 1;
 }
 
+static void recenter_head() {
+    input_latest(state.neutral, NULL);
+    pipeline_configure(state.neutral);
+    logMsg("saved neutral head position");
+}
+
 static int center_head_cb(XPLMCommandRef cmd, XPLMCommandPhase phase, void *refcon) {
     UNUSED(cmd);
     UNUSED(refcon);
     if(phase != xplm_CommandBegin) return 1;
-
-    for(int i = 0; i < 6; ++i) state.neutral[i] = state.head_in[i];
-    logMsg("saved neutral head position");
+    recenter_head();
     return 1;
 }
 
@@ -151,12 +197,37 @@ static int center_sim_cb(XPLMCommandRef cmd, XPLMCommandPhase phase, void *refco
     return 1;
 }
 
+static int reset_stats_cb(XPLMCommandRef cmd, XPLMCommandPhase phase, void *refcon) {
+    UNUSED(cmd);
+    UNUSED(refcon);
+    if(phase != xplm_CommandBegin) return 1;
+    health_reset();
+    return 1;
+}
+
 static void menu_cb(void *menu, void *refcon) {
     UNUSED(menu);
     UNUSED(refcon);
     settings_show();
 }
 
+static bool source_start() {
+    state.input_local = htk_settings.input_local;
+    state.rx_realtime = htk_settings.rx_realtime;
+    state.rx_cpu = htk_settings.rx_cpu;
+    priority_configure(state.rx_realtime, state.rx_cpu);
+    if(state.input_local) return local_start(state.head_in);
+    return server_start(state.head_in);
+}
+
+static void source_stop() {
+    if(state.input_local) {
+        local_stop();
+    } else {
+        server_stop();
+    }
+}
+
 int htk_start() {
     logMsg("finding plane rotation datarefs");
 
@@ -164,11 +235,14 @@ int htk_start() {
         state.head_in[i] = 0.0;
         state.neutral[i] = 0.0;
     }
+    input_reset();
+    pipeline_configure(state.neutral);
 
     logMsg("installing command handler");
     XPLMRegisterCommandHandler(state.cmd.toggle, toggle_cb, 0, NULL);
     XPLMRegisterCommandHandler(state.cmd.center_head_tracking, center_head_cb, 0, NULL);
     XPLMRegisterCommandHandler(state.cmd.center_sim_view, center_sim_cb, 0, NULL);
+    XPLMRegisterCommandHandler(state.cmd.reset_stats, reset_stats_cb, 0, NULL);
 
     int slot = XPLMAppendMenuItem(XPLMFindPluginsMenu(), "HeadTrack", NULL, 0);
     state.menu.id = XPLMCreateMenu("HeadTrack", XPLMFindPluginsMenu(), slot, menu_cb, NULL);
@@ -181,7 +255,12 @@ int htk_start() {
     state.menu.settings = XPLMAppendMenuItem(state.menu.id, "Settings…", NULL, 0);
 
     state.has_headshake = dr_find(&state.dr.headshake, "simcoders/headshale/override");
-    return server_start(state.head_in);
+    state.is_started = true;
+    publish_start();
+    char *forward_path = mkpathname(xpath_plugin(), "forward.txt", NULL);
+    forward_start(forward_path);
+    free(forward_path);
+    return source_start();
 }
 
 void htk_stop() {
@@ -189,35 +268,68 @@ void htk_stop() {
     XPLMUnregisterCommandHandler(state.cmd.toggle, toggle_cb, 0, NULL);
     XPLMUnregisterCommandHandler(state.cmd.center_head_tracking, center_head_cb, 0, NULL);
     XPLMUnregisterCommandHandler(state.cmd.center_sim_view, center_sim_cb, 0, NULL);
+    XPLMUnregisterCommandHandler(state.cmd.reset_stats, reset_stats_cb, 0, NULL);
     state.is_enabled = false;
-    server_stop();
+    state.is_started = false;
+    source_stop();
+    forward_stop();
+    publish_stop();
 }
 
 void htk_cleanup() {
     settings_cleanup();
+    api_cleanup();
+    // Outstanding completions can still reach into the settings, so the worker goes first.
+    worker_stop();
+    settings_watch_stop();
+    profiles_cleanup();
+    ccmpsc_delete(events);
+    events = NULL;
+    cc_log_set_async(false);
+    cc_log_flush();
 }
 
-static double limits[6];
+bool htk_post(ccmsg_t msg) {
+    if(!events) return false;
+    return ccmpsc_push(events, msg);
+}
+
+static void handle_events() {
+    ccmsg_t msgs[EVENT_BATCH];
+    size_t count = 0;
+    while((count = ccmpsc_pop_n(events, msgs, EVENT_BATCH)) > 0) {
+        for(size_t i = 0; i < count; ++i) {
+            switch((htk_event_t)msgs[i].kind) {
+            case HTK_EVENT_RECENTER:
+                recenter_head();
+                break;
+            case HTK_EVENT_INPUT_RATE:
+                htk_settings.input_rate = msgs[i].f32;
+                break;
+            }
+        }
+    }
+}
 
 void htk_plane_did_load() {
     state.must_reset = true;
 }
-static const double limits_out[6] = {100, 100, 100, 135, 90, 90};
-static double limits[6] = {50, 50, 50, 60, 60, 90};
 
 void htk_settings_did_update() {
-    for(int i = 0; i < 6; ++i) {
-        limits[i] = limits_out[i] / htk_settings.axes_sens[i];
+    pipeline_configure(state.neutral);
+    if(!state.is_started) return;
+    if(htk_settings.input_local != state.input_local
+       || htk_settings.rx_realtime != state.rx_realtime
+       || htk_settings.rx_cpu != state.rx_cpu) {
+        source_stop();
+        // Keeps the wake-up delays measured so far, to compare the new scheduling against.
+        health_save_baseline();
+        if(source_start()) htk_settings.last_error = NULL;
     }
 }
 
 static void reload_plane() {
-    if(!settings_load_plane()) {
-        if(state.plane_spec) settings_load_global();
-        state.plane_spec = false;
-    } else {
-        state.plane_spec = true;
-    }
+    settings_load_plane();
     state.must_reset = false;
     logMsg("recording default pilot's head position");
     state.viewport_ref[0] = dr_getf(&state.dr.ref_x);
@@ -225,40 +337,60 @@ static void reload_plane() {
     state.viewport_ref[2] = dr_getf(&state.dr.ref_z);
 }
 
+// Hands the frame to other processes and plugins, once the view has been moved.
+static void share_frame(publish_state_t published,
+                        uint64_t input_time,
+                        const double raw[6],
+                        const double input[6]) {
+    publish_frame(published, input_time, input, state.head, state.viewport_ref);
+    api_frame(published, input_time, raw, input, state.head);
+}
+
 void htk_frame() {
 
-    if(state.must_reset) reload_plane();
+    worker_poll();
+    handle_events();
+    cc_log_flush();
+    if(state.must_reset) {
+        reload_plane();
+    } else {
+        settings_poll_reload();
+    }
 
     int view_type = dr_geti(&state.dr.view_type);
 
-    memcpy(state.head, state.head_in, sizeof(state.head));
-
-    for(int i = 0; i < 6; ++i) {
-        htk_settings.head[i] = state.head_in[i];
-        state.head[i] -= state.neutral[i];
-        if(htk_settings.axes_invert[i]) state.head[i] = -state.head[i];
+    double latest[6], raw[6];
+    uint64_t latest_time = input_latest(latest, raw);
+    for(int i = 0; i < 6; ++i) htk_settings.head[i] = latest[i];
+
+    publish_state_t published = {
+        .is_enabled = state.is_enabled,
+        .is_active = false,
+        .is_local_input = state.input_local,
+    };
+    if(view_type != 1026 || !state.is_enabled) {
+        // Readers still get the input, and the last pose that was applied to the view.
+        share_frame(published, latest_time, raw, latest);
+        return;
     }
-    if(view_type != 1026 || !state.is_enabled) return;
-
-    remapd3(state.head,
-        limits,
-        limits_out,
-        1.f + htk_settings.translation_smooth);
-    normd3(state.head + 3);
-    remapd3(state.head + 3,
-        limits + 3,
-        limits_out + 3,
-        1.f + htk_settings.rotation_smooth);
+    published.is_active = true;
+
+    // Trackers are usually slower than the sim, so the pose is carried forward to this frame.
+    input_sample(microclock(), state.head);
+    pipeline_run(state.head);
 
     for(int i = 0; i < 6; ++i) {
         htk_settings.sim[i] = state.head[i];
     }
+    history_push(HTK_HISTORY_OUTPUT, microclock(), state.head);
+    pose_wrap(state.head);
 
     dr_setf(&state.dr.head_x, 1e-2 * state.head[0] + state.viewport_ref[0]);
     dr_setf(&state.dr.head_y, 1e-2 * state.head[1] + state.viewport_ref[1]);
     dr_setf(&state.dr.head_z, 1e-2 * state.head[2] + state.viewport_ref[2]);
 
-    dr_setf(&state.dr.head_hdg, normalize_rot(state.head[3]));
-    dr_setf(&state.dr.head_pit, normalize_rot(state.head[4]));
-    dr_setf(&state.dr.head_rll, normalize_rot(state.head[5]));
+    dr_setf(&state.dr.head_hdg, state.head[3]);
+    dr_setf(&state.dr.head_pit, state.head[4]);
+    dr_setf(&state.dr.head_rll, state.head[5]);
+    share_frame(published, latest_time, raw, latest);
 }
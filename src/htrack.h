@@ -7,6 +7,7 @@
 // =^•.•^=
 //===--------------------------------------------------------------------------------------------===
 #pragma once
+#include <ccore/message.h>
 #include <stdbool.h>
 
 #ifdef __cplusplus
@@ -21,9 +22,16 @@ typedef struct {
     float translation_smooth;
 
     float input_smooth;
+    bool input_local; // read poses from shared memory instead of UDP (global only)
+    bool rx_realtime; // run the receive thread with real-time priority (global only)
+    int rx_cpu; // CPU the receive thread is pinned to, or -1 for any (global only)
+
+    float ui_refresh_rate;
+    bool ui_legacy_renderer;
 
     float head[6];
     float sim[6];
+    float input_rate; // tracker packets per second
 
     const char *last_error;
 } htk_settings_t;
@@ -35,6 +43,15 @@ void htk_stop();
 void htk_cleanup();
 void htk_frame();
 
+/// Events other threads (and the UI) send to the sim thread, handled at the start of each frame.
+typedef enum {
+    HTK_EVENT_RECENTER = 1,     // no payload
+    HTK_EVENT_INPUT_RATE,       // f32: tracker packets per second
+} htk_event_t;
+
+/// Queues [msg] for the sim thread. Never blocks; returns false if the queue is full. Any thread.
+bool htk_post(ccmsg_t msg);
+
 void htk_settings_did_update();
 void htk_plane_did_load();
 
@@ -42,9 +59,22 @@ void settings_show();
 bool settings_is_visible();
 void settings_cleanup();
 
-bool settings_load_plane();
+typedef enum {
+    HTK_SAVE_IDLE,
+    HTK_SAVE_PENDING,
+    HTK_SAVE_DONE,
+    HTK_SAVE_FAILED,
+} htk_save_state_t;
+
+void settings_load_profiles();
+void settings_load_plane();
 void settings_load_global();
 bool settings_save(bool global);
+htk_save_state_t settings_save_state(const char **message);
+
+void settings_watch_start();
+void settings_watch_stop();
+bool settings_poll_reload();
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -0,0 +1,121 @@
+//===--------------------------------------------------------------------------------------------===
+// input.c - latest tracker samples, handed from the server thread to the sim thread
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include "input.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// How far past the last sample the pose is extrapolated. Beyond that, a lost packet would turn
+// into a visible overshoot.
+#define INPUT_MAX_HORIZON_USEC (50000)
+
+// Samples further apart than this are treated as a tracker that stopped and started again, and
+// aren't used to estimate velocity.
+#define INPUT_MAX_GAP_USEC (250000)
+
+typedef struct {
+    _Atomic uint64_t time;
+    _Atomic double pose[6];
+} sample_t;
+
+// The writer bumps [seq] to an odd number, updates the samples, then bumps it back to an even
+// one. Readers retry if [seq] was odd or changed while they were copying.
+static struct {
+    _Atomic uint32_t seq;
+    sample_t samples[2]; // [0] is the older one
+    _Atomic double raw[6]; // the newer sample, as it came from the tracker
+} input;
+
+void input_reset() {
+    atomic_fetch_add_explicit(&input.seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for(int s = 0; s < 2; ++s) {
+        atomic_store_explicit(&input.samples[s].time, 0, memory_order_relaxed);
+        for(int i = 0; i < 6; ++i) {
+            atomic_store_explicit(&input.samples[s].pose[i], 0.0, memory_order_relaxed);
+        }
+    }
+    for(int i = 0; i < 6; ++i) {
+        atomic_store_explicit(&input.raw[i], 0.0, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&input.seq, 1, memory_order_release);
+}
+
+void input_push(uint64_t time, const double raw[6], const double pose[6]) {
+    atomic_fetch_add_explicit(&input.seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    sample_t *older = &input.samples[0];
+    sample_t *newer = &input.samples[1];
+    atomic_store_explicit(&older->time,
+        atomic_load_explicit(&newer->time, memory_order_relaxed), memory_order_relaxed);
+    atomic_store_explicit(&newer->time, time, memory_order_relaxed);
+    for(int i = 0; i < 6; ++i) {
+        atomic_store_explicit(&older->pose[i],
+            atomic_load_explicit(&newer->pose[i], memory_order_relaxed), memory_order_relaxed);
+        atomic_store_explicit(&newer->pose[i], pose[i], memory_order_relaxed);
+        atomic_store_explicit(&input.raw[i], raw[i], memory_order_relaxed);
+    }
+
+    atomic_fetch_add_explicit(&input.seq, 1, memory_order_release);
+}
+
+// [raw] may be NULL.
+static void read_samples(uint64_t time[2], double pose[2][6], double raw[6]) {
+    for(;;) {
+        uint32_t seq = atomic_load_explicit(&input.seq, memory_order_acquire);
+        if(seq & 1) continue;
+
+        for(int s = 0; s < 2; ++s) {
+            time[s] = atomic_load_explicit(&input.samples[s].time, memory_order_relaxed);
+            for(int i = 0; i < 6; ++i) {
+                pose[s][i] = atomic_load_explicit(&input.samples[s].pose[i], memory_order_relaxed);
+            }
+        }
+        for(int i = 0; raw && i < 6; ++i) {
+            raw[i] = atomic_load_explicit(&input.raw[i], memory_order_relaxed);
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load_explicit(&input.seq, memory_order_relaxed) == seq) return;
+    }
+}
+
+uint64_t input_latest(double pose[6], double raw[6]) {
+    uint64_t time[2];
+    double samples[2][6];
+    read_samples(time, samples, raw);
+    for(int i = 0; i < 6; ++i) pose[i] = samples[1][i];
+    return time[1];
+}
+
+void input_sample(uint64_t now, double pose[6]) {
+    uint64_t time[2];
+    double samples[2][6];
+    read_samples(time, samples, NULL);
+    for(int i = 0; i < 6; ++i) pose[i] = samples[1][i];
+
+    uint64_t period = time[1] - time[0];
+    if(!time[0] || time[1] <= time[0] || period > INPUT_MAX_GAP_USEC || now <= time[1]) return;
+
+    uint64_t horizon = now - time[1];
+    if(horizon > period) horizon = period;
+    if(horizon > INPUT_MAX_HORIZON_USEC) horizon = INPUT_MAX_HORIZON_USEC;
+    double t = (double)horizon / (double)period;
+
+    for(int i = 0; i < 6; ++i) {
+        double delta = samples[1][i] - samples[0][i];
+        // Rotations that crossed +/-180 between the two samples moved the short way round.
+        if(i >= 3) {
+            if(delta > 180.0) delta -= 360.0;
+            if(delta < -180.0) delta += 360.0;
+        }
+        pose[i] += delta * t;
+    }
+}
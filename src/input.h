@@ -0,0 +1,35 @@
+//===--------------------------------------------------------------------------------------------===
+// input.h - latest tracker samples, handed from the server thread to the sim thread
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Forgets every sample.
+void input_reset();
+
+/// Records the tracker [pose] received at [time] (microseconds), after input smoothing, along
+/// with the [raw] pose it was smoothed from. Server thread only.
+void input_push(uint64_t time, const double raw[6], const double pose[6]);
+
+/// Copies the most recent sample into [pose], and the tracker pose it was smoothed from into
+/// [raw] if it isn't NULL. Returns when the sample was received (microseconds, or 0 if there
+/// hasn't been one yet). Any thread.
+uint64_t input_latest(double pose[6], double raw[6]);
+
+/// Estimates the pose at [now] (microseconds) from the last two samples, so that a tracker
+/// slower than the sim still moves the view every frame. The estimate runs ahead of the last
+/// sample by at most one tracker period, and never by more than 50ms. Any thread.
+void input_sample(uint64_t now, double pose[6]);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
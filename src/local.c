@@ -0,0 +1,243 @@
+//===--------------------------------------------------------------------------------------------===
+// local.c - shared-memory input for trackers running on the same machine
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include "local.h"
+#include "server.h"
+#include "htrack.h"
+#include "health.h"
+#include <acfutils/assert.h>
+#include <acfutils/log.h>
+#include <acfutils/thread.h>
+#include <acfutils/time.h>
+#include <ccore/log.h>
+
+#if IBM
+
+bool local_start(double *input) {
+    UNUSED(input);
+    htk_settings.last_error = "shared memory input is not available on Windows";
+    logMsg("unable to start shared memory input: %s", htk_settings.last_error);
+    return false;
+}
+
+void local_stop() {
+}
+
+#else
+#include <htrack/shm.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#if APL
+#include <dispatch/dispatch.h>
+#endif
+
+// How long the thread sleeps when no pose comes in, before checking whether it should stop.
+#define WAIT_TIMEOUT_MSEC (250)
+
+// Without futexes, the thread sleeps on a named semaphore that the writer posts instead.
+static struct {
+    bool is_running;
+    thread_t thread;
+    htk_shm_input_t *shm;
+#if !LIN
+    sem_t *wake;
+#endif
+#if APL
+    dispatch_source_t timer;
+    dispatch_semaphore_t timer_done;
+#endif
+} local;
+
+#if APL
+// macOS has no sem_timedwait(), so a timer posts the semaphore instead whenever the thread is
+// asleep, which gives it the same timeout.
+static void timer_fired(void *refcon) {
+    UNUSED(refcon);
+    if(__atomic_load_n(&local.shm->is_waiting, __ATOMIC_RELAXED)) sem_post(local.wake);
+}
+
+static void timer_cancelled(void *refcon) {
+    UNUSED(refcon);
+    dispatch_semaphore_signal(local.timer_done);
+}
+
+static void timer_start() {
+    uint64_t period = WAIT_TIMEOUT_MSEC * NSEC_PER_MSEC;
+    local.timer_done = dispatch_semaphore_create(0);
+    local.timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
+                                         dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+    dispatch_source_set_timer(local.timer, dispatch_time(DISPATCH_TIME_NOW, period), period,
+                              period / 10);
+    dispatch_source_set_event_handler_f(local.timer, timer_fired);
+    dispatch_source_set_cancel_handler_f(local.timer, timer_cancelled);
+    dispatch_resume(local.timer);
+}
+
+// Returns once the handler can't run anymore.
+static void timer_stop() {
+    dispatch_source_cancel(local.timer);
+    dispatch_semaphore_wait(local.timer_done, DISPATCH_TIME_FOREVER);
+    dispatch_release(local.timer);
+    dispatch_release(local.timer_done);
+}
+#endif
+
+// The writer stores [count] then reads [is_waiting]; we store [is_waiting] then read [count].
+// Either we see the new pose, or the writer sees we're asleep and wakes us up.
+static void wait_for_pose(htk_shm_input_t *shm, uint32_t seen) {
+    __atomic_store_n(&shm->is_waiting, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&shm->count, __ATOMIC_SEQ_CST) == seen
+       && __atomic_load_n(&local.is_running, __ATOMIC_SEQ_CST)) {
+#if LIN
+        struct timespec timeout = {0, WAIT_TIMEOUT_MSEC * 1000000L};
+        syscall(SYS_futex, &shm->count, FUTEX_WAIT, seen, &timeout, NULL, 0);
+#elif APL
+        sem_wait(local.wake);
+#else
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += WAIT_TIMEOUT_MSEC * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        sem_timedwait(local.wake, &deadline);
+#endif
+    }
+    __atomic_store_n(&shm->is_waiting, 0, __ATOMIC_RELAXED);
+#if !LIN
+    // The writer posts once per pose while we're asleep: the extra posts would only wake us up
+    // for nothing.
+    while(sem_trywait(local.wake) == 0) {}
+#endif
+}
+
+static void local_track_server(void *data) {
+    thread_set_name("headtrack shm");
+    CCINFO("Head tracking server now reading shared memory at %s", HTK_SHM_INPUT_NAME);
+
+    receiver_t rx;
+    receiver_init(&rx, data);
+
+    htk_shm_input_t *shm = local.shm;
+    uint32_t next = __atomic_load_n(&shm->count, __ATOMIC_ACQUIRE);
+    while(local.is_running) {
+        uint32_t count = __atomic_load_n(&shm->count, __ATOMIC_ACQUIRE);
+        if(count == next) {
+            wait_for_pose(shm, next);
+            receiver_tick(&rx, microclock());
+            continue;
+        }
+
+        // Anything older than the ring has already been overwritten.
+        if(count - next > HTK_SHM_INPUT_SLOTS) next = count - HTK_SHM_INPUT_SLOTS;
+
+        // When we fall behind, the poses we catch up on keep the spacing the tracker wrote them
+        // with, so the filter doesn't see them as a burst.
+        uint64_t now = microclock();
+        uint64_t times[HTK_SHM_INPUT_SLOTS];
+        double poses[HTK_SHM_INPUT_SLOTS][6];
+        uint32_t read = 0;
+        for(; next != count; ++next) {
+            if(htk_shm_input_read(shm, next, &times[read], poses[read])) read += 1;
+        }
+        for(uint32_t i = 0; i < read; ++i) {
+            uint64_t age = times[read - 1] - times[i];
+            receiver_push(&rx, age < now ? now - age : now, poses[i]);
+        }
+        if(read) {
+            // The writer stamps poses with the same clock, so this is how long we took to wake up.
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            uint64_t handled = (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+            if(handled >= times[read - 1]) health_record_delay(handled - times[read - 1]);
+        }
+        receiver_tick(&rx, now);
+    }
+
+    CCINFO("shutting down shared memory input");
+}
+
+bool local_start(double *input) {
+    ASSERT(input);
+    logMsg("starting shared memory input");
+
+    // A segment left behind by a crash would still have its old count and sequence numbers.
+    shm_unlink(HTK_SHM_INPUT_NAME);
+    int fd = shm_open(HTK_SHM_INPUT_NAME, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if(fd < 0 || ftruncate(fd, sizeof(htk_shm_input_t))) {
+        htk_settings.last_error = strerror(errno);
+        logMsg("unable to create shared memory input: %s", htk_settings.last_error);
+        if(fd >= 0) {
+            close(fd);
+            shm_unlink(HTK_SHM_INPUT_NAME);
+        }
+        return false;
+    }
+
+    void *mem = mmap(NULL, sizeof(htk_shm_input_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED) {
+        htk_settings.last_error = strerror(errno);
+        logMsg("unable to map shared memory input: %s", htk_settings.last_error);
+        shm_unlink(HTK_SHM_INPUT_NAME);
+        return false;
+    }
+
+#if !LIN
+    // Trackers open the semaphore along with the segment, so it has to exist first.
+    sem_unlink(HTK_SHM_INPUT_WAKE_NAME);
+    local.wake = sem_open(HTK_SHM_INPUT_WAKE_NAME, O_CREAT | O_EXCL, S_IRUSR | S_IWUSR, 0);
+    if(local.wake == SEM_FAILED) {
+        htk_settings.last_error = strerror(errno);
+        logMsg("unable to create shared memory input semaphore: %s", htk_settings.last_error);
+        munmap(mem, sizeof(htk_shm_input_t));
+        shm_unlink(HTK_SHM_INPUT_NAME);
+        return false;
+    }
+#endif
+
+    // The segment starts zeroed. Writers check the magic number last, once the rest is valid.
+    local.shm = mem;
+    local.shm->version = HTK_SHM_INPUT_VERSION;
+    local.shm->slot_count = HTK_SHM_INPUT_SLOTS;
+    __atomic_store_n(&local.shm->magic, HTK_SHM_INPUT_MAGIC, __ATOMIC_RELEASE);
+
+    local.is_running = true;
+#if APL
+    timer_start();
+#endif
+    thread_create(&local.thread, local_track_server, input);
+    return true;
+}
+
+void local_stop() {
+    if(!local.is_running) return;
+    __atomic_store_n(&local.is_running, false, __ATOMIC_SEQ_CST);
+    // Rather than waiting for the timeout. On Linux, a stop that lands between the thread's last
+    // check and its futex wait still costs one timeout, but no more.
+#if LIN
+    syscall(SYS_futex, &local.shm->count, FUTEX_WAKE, 1, NULL, NULL, 0);
+#else
+    sem_post(local.wake);
+#endif
+    thread_join(&local.thread);
+#if APL
+    timer_stop();
+#endif
+
+    __atomic_store_n(&local.shm->is_closed, 1, __ATOMIC_RELAXED);
+#if !LIN
+    sem_close(local.wake);
+    sem_unlink(HTK_SHM_INPUT_WAKE_NAME);
+#endif
+    shm_unlink(HTK_SHM_INPUT_NAME);
+    munmap(local.shm, sizeof(htk_shm_input_t));
+    local.shm = NULL;
+}
+
+#endif
@@ -0,0 +1,25 @@
+//===--------------------------------------------------------------------------------------------===
+// local.h - shared-memory input for trackers running on the same machine
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Creates the segment described in include/htrack/shm.h, and starts a thread that feeds the
+/// poses written to it into [input], like the UDP server does. Not available on Windows.
+bool local_start(double *input);
+
+/// Stops the thread and removes the segment. Trackers still attached see it marked as closed.
+void local_stop();
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
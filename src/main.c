@@ -1,5 +1,7 @@
 #include "htrack.h"
 #include "paths.h"
+#include "api.h"
+#include <htrack/api.h>
 #include <XPLMPlugin.h>
 #include <XPLMUtilities.h>
 #include <XPLMDisplay.h>
@@ -34,7 +36,7 @@ PLUGIN_API float flight_loop(float since_last, float since_last_fl, int count, v
 PLUGIN_API int XPluginStart(char * outName, char * outSig, char *outDesc) {
     // Plugin details
     strcpy(outName, "HeadTrack");
-    strcpy(outSig, "com.amyinorbit.htrack");
+    strcpy(outSig, HTK_PLUGIN_SIGNATURE);
     strcpy(outDesc, "Lightweight head tracking plugin");
     XPLMEnableFeature("XPLM_USE_NATIVE_PATHS", 1);
 
@@ -67,8 +69,8 @@ PLUGIN_API void XPluginDisable(void) {
 
 PLUGIN_API void XPluginReceiveMessage(XPLMPluginID id, intptr_t inMessage, void * inParam) {
     UNUSED(id);
-    UNUSED(inParam);
 
+    if(api_handle_message(inMessage, inParam)) return;
     if(inMessage != XPLM_MSG_PLANE_LOADED) return;
     xpath_reload();
     htk_plane_did_load();
@@ -21,6 +21,7 @@
 static char plugin_path[1024];
 static char xsystem_path[1024];
 static char aircraft_path[1024];
+static char aircraft_file[1024];
 
 static void fix_path(char *path) {
     fix_pathsep(path);
@@ -42,6 +43,7 @@ void xpath_reload() {
 	fix_pathsep(plugin_path);
 	fix_pathsep(aircraft_path);
 #endif	/* IBM */
+    strlcpy(aircraft_file, aircraft_path, sizeof(aircraft_file));
     
 	/* cut off the trailing path component (our filename) */
     char *p = NULL;
@@ -79,3 +81,7 @@ const char *xpath_plugin() {
 const char *xpath_aircraft() {
     return aircraft_path;
 }
+
+const char *xpath_aircraft_file() {
+    return aircraft_file;
+}
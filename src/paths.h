@@ -18,6 +18,7 @@ void xpath_reload();
 const char *xpath_system();
 const char *xpath_plugin();
 const char *xpath_aircraft();
+const char *xpath_aircraft_file();
 
 #ifdef __cplusplus
 } /* extern "C" */
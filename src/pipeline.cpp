@@ -0,0 +1,104 @@
+//===--------------------------------------------------------------------------------------------===
+// pipeline.cpp - tracker-to-sim pose pipeline, specialised for the active settings
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include "pipeline.h"
+#include "htrack.h"
+#include "pose.h"
+
+namespace {
+
+const double limits_out[6] = {100, 100, 100, 135, 90, 90};
+
+// Everything the stages need, computed once per settings change rather than every frame.
+struct Config {
+    double neutral[6];
+    double sign[6];
+    double limits[6];
+    double factors[6];
+};
+
+struct Neutral {
+    static void apply(const Config &config, double pose[6]) {
+        for(int i = 0; i < 6; ++i) pose[i] -= config.neutral[i];
+    }
+};
+
+struct Invert {
+    static void apply(const Config &config, double pose[6]) {
+        for(int i = 0; i < 6; ++i) pose[i] *= config.sign[i];
+    }
+};
+
+struct Curve {
+    static void apply(const Config &config, double pose[6]) {
+        pose_wrap(pose);
+        pose_remap(pose, config.limits, limits_out, config.factors);
+    }
+};
+
+// A stage that is only there when [enabled] is true. When it isn't, it compiles to nothing.
+template <bool enabled, typename Stage>
+struct Optional {
+    static void apply(const Config &config, double pose[6]) {
+        if constexpr(enabled) Stage::apply(config, pose);
+    }
+};
+
+template <typename... Stages>
+struct Pipeline {
+    static void run(const Config &config, double pose[6]) {
+        (Stages::apply(config, pose), ...);
+    }
+};
+
+template <bool has_neutral, bool has_invert>
+void run(const Config &config, double pose[6]) {
+    Pipeline<
+        Optional<has_neutral, Neutral>,
+        Optional<has_invert, Invert>,
+        Curve
+    >::run(config, pose);
+}
+
+using RunFn = void (*)(const Config &, double *);
+
+// Indexed by [has_neutral][has_invert].
+const RunFn variants[2][2] = {
+    {run<false, false>, run<false, true>},
+    {run<true, false>, run<true, true>},
+};
+
+Config config = {
+    {0, 0, 0, 0, 0, 0},
+    {1, 1, 1, 1, 1, 1},
+    {50, 50, 50, 60, 60, 90},
+    {1, 1, 1, 1, 1, 1},
+};
+RunFn active = variants[0][0];
+
+}
+
+void pipeline_configure(const double neutral[6]) {
+    bool has_neutral = false;
+    bool has_invert = false;
+
+    for(int i = 0; i < 6; ++i) {
+        config.neutral[i] = neutral[i];
+        config.sign[i] = htk_settings.axes_invert[i] ? -1.0 : 1.0;
+        config.limits[i] = limits_out[i] / htk_settings.axes_sens[i];
+        config.factors[i] = 1.0 + (i < 3 ? htk_settings.translation_smooth : htk_settings.rotation_smooth);
+
+        has_neutral |= neutral[i] != 0.0;
+        has_invert |= htk_settings.axes_invert[i];
+    }
+    active = variants[has_neutral][has_invert];
+}
+
+void pipeline_run(double pose[6]) {
+    active(config, pose);
+}
@@ -0,0 +1,25 @@
+//===--------------------------------------------------------------------------------------------===
+// pipeline.h - tracker-to-sim pose pipeline, specialised for the active settings
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Rebuilds the pipeline from htk_settings and the [neutral] head position. Stages that the
+/// settings make useless are left out entirely. Sim thread only, whenever either changes.
+void pipeline_configure(const double neutral[6]);
+
+/// Turns a [pose] from the tracker into the head offset sent to the sim, in place. Sim thread
+/// only.
+void pipeline_run(double pose[6]);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,284 @@
+//===--------------------------------------------------------------------------------------------===
+// pose.c - vectorised 6-axis pose kernels, with runtime selection of the instruction set
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include "pose.h"
+#include "math.h"
+#include <acfutils/log.h>
+#include <stdalign.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAS_SSE2 1
+#if defined(__GNUC__)
+#define HAS_AVX2 1
+#endif
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define HAS_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define PAD_AXES (8)
+
+// Bit pattern of the mantissa field, as a double (it's a denormal).
+#define MANTISSA_MASK (0x0.fffffffffffffp-1022)
+
+typedef struct {
+    alignas(32) double v[PAD_AXES];
+} padded_t;
+
+static inline void pad(padded_t *out, const double in[HTK_POSE_AXES], double fill) {
+    memcpy(out->v, in, HTK_POSE_AXES * sizeof(double));
+    for(int i = HTK_POSE_AXES; i < PAD_AXES; ++i) out->v[i] = fill;
+}
+
+static inline void unpad(double out[HTK_POSE_AXES], const padded_t *in) {
+    memcpy(out, in->v, HTK_POSE_AXES * sizeof(double));
+}
+
+typedef struct {
+    const char *name;
+    void (*remap)(double *, const double *, const double *, const double *);
+    void (*wrap)(double *);
+    void (*lerp)(double *, const double *, const double *, double);
+    void (*filter)(double *, const double *, const double *);
+} kernels_t;
+
+// MARK: - Scalar reference
+
+static void scalar_remap(double v[HTK_POSE_AXES],
+                         const double old_m[HTK_POSE_AXES],
+                         const double new_m[HTK_POSE_AXES],
+                         const double factor[HTK_POSE_AXES]) {
+    for(int i = 0; i < HTK_POSE_AXES; ++i) {
+        v[i] = remapd(v[i], old_m[i], new_m[i], factor[i]);
+    }
+}
+
+static void scalar_wrap(double v[HTK_POSE_AXES]) {
+    normd3(v + 3);
+}
+
+static void scalar_lerp(double out[HTK_POSE_AXES],
+                        const double a[HTK_POSE_AXES],
+                        const double b[HTK_POSE_AXES],
+                        double t) {
+    for(int i = 0; i < HTK_POSE_AXES; ++i) {
+        out[i] = lerp(a[i], b[i], t);
+    }
+}
+
+static void scalar_filter(double state[HTK_POSE_AXES],
+                          const double in[HTK_POSE_AXES],
+                          const double alpha[HTK_POSE_AXES]) {
+    for(int i = 0; i < HTK_POSE_AXES; ++i) {
+        state[i] += (in[i] - state[i]) * alpha[i];
+    }
+}
+
+static const kernels_t scalar_kernels = {
+    "scalar", scalar_remap, scalar_wrap, scalar_lerp, scalar_filter
+};
+
+// MARK: - SSE2
+
+#if HAS_SSE2
+#define vec_t __m128d
+#define LANES (2)
+#define KERNEL(name) sse2_##name
+#define v_set1(x) _mm_set1_pd(x)
+#define v_load(p) _mm_load_pd(p)
+#define v_store(p, x) _mm_store_pd(p, x)
+#define v_add(a, b) _mm_add_pd(a, b)
+#define v_sub(a, b) _mm_sub_pd(a, b)
+#define v_mul(a, b) _mm_mul_pd(a, b)
+#define v_div(a, b) _mm_div_pd(a, b)
+#define v_min(a, b) _mm_min_pd(a, b)
+#define v_max(a, b) _mm_max_pd(a, b)
+#define v_and(a, b) _mm_and_pd(a, b)
+#define v_or(a, b) _mm_or_pd(a, b)
+#define v_andnot(a, b) _mm_andnot_pd(a, b)
+#define v_lt(a, b) _mm_cmplt_pd(a, b)
+#define v_gt(a, b) _mm_cmpgt_pd(a, b)
+#define v_ge(a, b) _mm_cmpge_pd(a, b)
+#define v_shr52(x) _mm_castsi128_pd(_mm_srli_epi64(_mm_castpd_si128(x), 52))
+#define v_shl52(x) _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(x), 52))
+
+#include "pose_kernels.h"
+
+static const kernels_t sse2_kernels = {
+    "SSE2", sse2_remap, sse2_wrap, sse2_lerp, sse2_filter
+};
+
+#undef vec_t
+#undef LANES
+#undef KERNEL
+#undef v_set1
+#undef v_load
+#undef v_store
+#undef v_add
+#undef v_sub
+#undef v_mul
+#undef v_div
+#undef v_min
+#undef v_max
+#undef v_and
+#undef v_or
+#undef v_andnot
+#undef v_lt
+#undef v_gt
+#undef v_ge
+#undef v_shr52
+#undef v_shl52
+#endif
+
+// MARK: - AVX2
+
+#if HAS_AVX2
+#ifdef __clang__
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#define vec_t __m256d
+#define LANES (4)
+#define KERNEL(name) avx2_##name
+#define v_set1(x) _mm256_set1_pd(x)
+#define v_load(p) _mm256_load_pd(p)
+#define v_store(p, x) _mm256_store_pd(p, x)
+#define v_add(a, b) _mm256_add_pd(a, b)
+#define v_sub(a, b) _mm256_sub_pd(a, b)
+#define v_mul(a, b) _mm256_mul_pd(a, b)
+#define v_div(a, b) _mm256_div_pd(a, b)
+#define v_min(a, b) _mm256_min_pd(a, b)
+#define v_max(a, b) _mm256_max_pd(a, b)
+#define v_and(a, b) _mm256_and_pd(a, b)
+#define v_or(a, b) _mm256_or_pd(a, b)
+#define v_andnot(a, b) _mm256_andnot_pd(a, b)
+#define v_lt(a, b) _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define v_gt(a, b) _mm256_cmp_pd(a, b, _CMP_GT_OQ)
+#define v_ge(a, b) _mm256_cmp_pd(a, b, _CMP_GE_OQ)
+#define v_shr52(x) _mm256_castsi256_pd(_mm256_srli_epi64(_mm256_castpd_si256(x), 52))
+#define v_shl52(x) _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(x), 52))
+
+#include "pose_kernels.h"
+
+static const kernels_t avx2_kernels = {
+    "AVX2", avx2_remap, avx2_wrap, avx2_lerp, avx2_filter
+};
+
+#undef vec_t
+#undef LANES
+#undef KERNEL
+#undef v_set1
+#undef v_load
+#undef v_store
+#undef v_add
+#undef v_sub
+#undef v_mul
+#undef v_div
+#undef v_min
+#undef v_max
+#undef v_and
+#undef v_or
+#undef v_andnot
+#undef v_lt
+#undef v_gt
+#undef v_ge
+#undef v_shr52
+#undef v_shl52
+
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif
+
+// MARK: - NEON
+
+#if HAS_NEON
+#define vec_t float64x2_t
+#define LANES (2)
+#define KERNEL(name) neon_##name
+#define AS_U64(x) vreinterpretq_u64_f64(x)
+#define AS_F64(x) vreinterpretq_f64_u64(x)
+#define v_set1(x) vdupq_n_f64(x)
+#define v_load(p) vld1q_f64(p)
+#define v_store(p, x) vst1q_f64(p, x)
+#define v_add(a, b) vaddq_f64(a, b)
+#define v_sub(a, b) vsubq_f64(a, b)
+#define v_mul(a, b) vmulq_f64(a, b)
+#define v_div(a, b) vdivq_f64(a, b)
+#define v_min(a, b) vminq_f64(a, b)
+#define v_max(a, b) vmaxq_f64(a, b)
+#define v_and(a, b) AS_F64(vandq_u64(AS_U64(a), AS_U64(b)))
+#define v_or(a, b) AS_F64(vorrq_u64(AS_U64(a), AS_U64(b)))
+#define v_andnot(a, b) AS_F64(vbicq_u64(AS_U64(b), AS_U64(a)))
+#define v_lt(a, b) AS_F64(vcltq_f64(a, b))
+#define v_gt(a, b) AS_F64(vcgtq_f64(a, b))
+#define v_ge(a, b) AS_F64(vcgeq_f64(a, b))
+#define v_shr52(x) AS_F64(vshrq_n_u64(AS_U64(x), 52))
+#define v_shl52(x) AS_F64(vshlq_n_u64(AS_U64(x), 52))
+
+#include "pose_kernels.h"
+
+static const kernels_t neon_kernels = {
+    "NEON", neon_remap, neon_wrap, neon_lerp, neon_filter
+};
+#endif
+
+// MARK: - Dispatch
+
+static const kernels_t *kernels = &scalar_kernels;
+
+void pose_init(bool use_reference) {
+    kernels = &scalar_kernels;
+    if(!use_reference) {
+#if HAS_NEON
+        kernels = &neon_kernels;
+#elif HAS_SSE2
+        kernels = &sse2_kernels;
+#if HAS_AVX2
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) kernels = &avx2_kernels;
+#endif
+#endif
+    }
+    logMsg("using %s pose kernels", kernels->name);
+}
+
+const char *pose_kernels_name() {
+    return kernels->name;
+}
+
+void pose_remap(double v[HTK_POSE_AXES],
+                const double old_m[HTK_POSE_AXES],
+                const double new_m[HTK_POSE_AXES],
+                const double factor[HTK_POSE_AXES]) {
+    kernels->remap(v, old_m, new_m, factor);
+}
+
+void pose_wrap(double v[HTK_POSE_AXES]) {
+    kernels->wrap(v);
+}
+
+void pose_lerp(double out[HTK_POSE_AXES],
+               const double a[HTK_POSE_AXES],
+               const double b[HTK_POSE_AXES],
+               double t) {
+    kernels->lerp(out, a, b, t);
+}
+
+void pose_filter(double state[HTK_POSE_AXES],
+                 const double in[HTK_POSE_AXES],
+                 const double alpha[HTK_POSE_AXES]) {
+    kernels->filter(state, in, alpha);
+}
@@ -0,0 +1,50 @@
+//===--------------------------------------------------------------------------------------------===
+// pose.h - vectorised 6-axis pose kernels
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Number of axes in a pose: x, y, z, heading, pitch, roll.
+#define HTK_POSE_AXES (6)
+
+/// Picks the fastest implementation the CPU supports. Until this is called, and when
+/// [use_reference] is true, the scalar functions from math.h are used.
+void pose_init(bool use_reference);
+
+/// Name of the implementation picked by pose_init().
+const char *pose_kernels_name();
+
+/// Applies remapd() to each axis of [v], with a per-axis [factor]. The SIMD versions compute the
+/// power with a polynomial approximation whose relative error is below 1e-9.
+void pose_remap(double v[HTK_POSE_AXES],
+                const double old_m[HTK_POSE_AXES],
+                const double new_m[HTK_POSE_AXES],
+                const double factor[HTK_POSE_AXES]);
+
+/// Applies normalize_rot() to the rotation axes of [v]. Translation axes are left alone.
+void pose_wrap(double v[HTK_POSE_AXES]);
+
+/// Sets [out] to lerp(a, b, t) for each axis. [out] may alias [a] or [b].
+void pose_lerp(double out[HTK_POSE_AXES],
+               const double a[HTK_POSE_AXES],
+               const double b[HTK_POSE_AXES],
+               double t);
+
+/// Moves [state] towards [in] by a per-axis fraction [alpha], which must already be in [0, 1]:
+/// a single step of an exponential moving average.
+void pose_filter(double state[HTK_POSE_AXES],
+                 const double in[HTK_POSE_AXES],
+                 const double alpha[HTK_POSE_AXES]);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,135 @@
+//===--------------------------------------------------------------------------------------------===
+// pose_kernels.h - SIMD pose kernel bodies, shared by every instruction set
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+// No include guard: pose.c includes this once per instruction set, after defining vec_t, LANES,
+// KERNEL(name) and the v_* primitives for it.
+
+// Poses are copied into buffers padded to PAD_AXES, so every instruction set can run whole
+// vectors without a scalar tail.
+
+static inline vec_t KERNEL(blend)(vec_t mask, vec_t a, vec_t b) {
+    return v_or(v_and(mask, b), v_andnot(mask, a));
+}
+
+// Integral [n] (as a double) to the double 2^n, by writing n + 1023 straight into the exponent.
+static inline vec_t KERNEL(exp2i)(vec_t n) {
+    n = v_max(v_min(n, v_set1(1023.0)), v_set1(-1022.0));
+    return v_shl52(v_add(n, v_set1(0x1p52 + 1023.0)));
+}
+
+// log2 for x > 0: x = m * 2^e with m in [sqrt(1/2), sqrt(2)), and log(m) from the series in
+// s = (m - 1) / (m + 1), which is below 0.172, so six terms are good to about 1e-11.
+static inline vec_t KERNEL(log2)(vec_t x) {
+    vec_t e = v_sub(v_or(v_shr52(x), v_set1(0x1p52)), v_set1(0x1p52 + 1023.0));
+    vec_t m = v_or(v_and(x, v_set1(MANTISSA_MASK)), v_set1(1.0));
+
+    vec_t is_big = v_ge(m, v_set1(1.4142135623730951));
+    m = KERNEL(blend)(is_big, m, v_mul(m, v_set1(0.5)));
+    e = KERNEL(blend)(is_big, e, v_add(e, v_set1(1.0)));
+
+    vec_t s = v_div(v_sub(m, v_set1(1.0)), v_add(m, v_set1(1.0)));
+    vec_t s2 = v_mul(s, s);
+    vec_t p = v_set1(1.0 / 11.0);
+    p = v_add(v_mul(p, s2), v_set1(1.0 / 9.0));
+    p = v_add(v_mul(p, s2), v_set1(1.0 / 7.0));
+    p = v_add(v_mul(p, s2), v_set1(1.0 / 5.0));
+    p = v_add(v_mul(p, s2), v_set1(1.0 / 3.0));
+    p = v_add(v_mul(p, s2), v_set1(1.0));
+    vec_t ln_m = v_mul(v_mul(p, s), v_set1(2.0));
+    return v_add(e, v_mul(ln_m, v_set1(1.4426950408889634)));
+}
+
+// 2^y: split y into an integer and r in [-1/2, 1/2], and take e^(r ln 2) from its Taylor
+// series. Ten terms keep the relative error below 1e-12.
+static inline vec_t KERNEL(exp2)(vec_t y) {
+    // Adding and removing 1.5 * 2^52 rounds to the nearest integer without SSE4.1.
+    vec_t n = v_sub(v_add(y, v_set1(0x1.8p52)), v_set1(0x1.8p52));
+    vec_t r = v_mul(v_sub(y, n), v_set1(0.6931471805599453));
+
+    vec_t p = v_set1(1.0 / 3628800.0);
+    p = v_add(v_mul(p, r), v_set1(1.0 / 362880.0));
+    p = v_add(v_mul(p, r), v_set1(1.0 / 40320.0));
+    p = v_add(v_mul(p, r), v_set1(1.0 / 5040.0));
+    p = v_add(v_mul(p, r), v_set1(1.0 / 720.0));
+    p = v_add(v_mul(p, r), v_set1(1.0 / 120.0));
+    p = v_add(v_mul(p, r), v_set1(1.0 / 24.0));
+    p = v_add(v_mul(p, r), v_set1(1.0 / 6.0));
+    p = v_add(v_mul(p, r), v_set1(0.5));
+    p = v_add(v_mul(p, r), v_set1(1.0));
+    p = v_add(v_mul(p, r), v_set1(1.0));
+    return v_mul(p, KERNEL(exp2i)(n));
+}
+
+static void KERNEL(remap)(double v[HTK_POSE_AXES],
+                          const double old_m[HTK_POSE_AXES],
+                          const double new_m[HTK_POSE_AXES],
+                          const double factor[HTK_POSE_AXES]) {
+    padded_t pv, po, pn, pf;
+    pad(&pv, v, 0.0);
+    pad(&po, old_m, 1.0);
+    pad(&pn, new_m, 1.0);
+    pad(&pf, factor, 1.0);
+
+    for(int i = 0; i < PAD_AXES; i += LANES) {
+        vec_t x = v_load(pv.v + i);
+        vec_t sign = v_and(x, v_set1(-0.0));
+        vec_t base = v_div(v_andnot(v_set1(-0.0), x), v_load(po.v + i));
+
+        vec_t power = KERNEL(exp2)(v_mul(v_load(pf.v + i), KERNEL(log2)(base)));
+        power = v_and(power, v_gt(base, v_set1(0.0))); // 0^f is 0, but log2(0) is not finite
+        v_store(pv.v + i, v_or(v_mul(power, v_load(pn.v + i)), sign));
+    }
+    unpad(v, &pv);
+}
+
+static void KERNEL(wrap)(double v[HTK_POSE_AXES]) {
+    static const padded_t is_rotation = {{0, 0, 0, 1, 1, 1, 0, 0}};
+    padded_t pv;
+    pad(&pv, v, 0.0);
+
+    for(int i = 0; i < PAD_AXES; i += LANES) {
+        vec_t x = v_load(pv.v + i);
+        vec_t rot = v_load(is_rotation.v + i);
+        vec_t up = v_and(v_lt(x, v_set1(-180.0)), v_set1(360.0));
+        vec_t down = v_and(v_ge(x, v_set1(180.0)), v_set1(360.0));
+        v_store(pv.v + i, v_add(x, v_mul(rot, v_sub(up, down))));
+    }
+    unpad(v, &pv);
+}
+
+static void KERNEL(lerp)(double out[HTK_POSE_AXES],
+                         const double a[HTK_POSE_AXES],
+                         const double b[HTK_POSE_AXES],
+                         double t) {
+    padded_t pa, pb;
+    pad(&pa, a, 0.0);
+    pad(&pb, b, 0.0);
+
+    vec_t vt = v_set1(clampd(t, 0, 1));
+    vec_t vs = v_set1(1.0 - clampd(t, 0, 1));
+    for(int i = 0; i < PAD_AXES; i += LANES) {
+        v_store(pa.v + i, v_add(v_mul(v_load(pa.v + i), vs), v_mul(v_load(pb.v + i), vt)));
+    }
+    unpad(out, &pa);
+}
+
+static void KERNEL(filter)(double state[HTK_POSE_AXES],
+                           const double in[HTK_POSE_AXES],
+                           const double alpha[HTK_POSE_AXES]) {
+    padded_t ps, pi, pa;
+    pad(&ps, state, 0.0);
+    pad(&pi, in, 0.0);
+    pad(&pa, alpha, 0.0);
+
+    for(int i = 0; i < PAD_AXES; i += LANES) {
+        vec_t s = v_load(ps.v + i);
+        vec_t delta = v_sub(v_load(pi.v + i), s);
+        v_store(ps.v + i, v_add(s, v_mul(delta, v_load(pa.v + i))));
+    }
+    unpad(state, &ps);
+}
@@ -0,0 +1,124 @@
+//===--------------------------------------------------------------------------------------------===
+// priority.c - opt-in real-time scheduling and CPU pinning for the receive thread
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#if LIN
+#define _GNU_SOURCE // pthread_setaffinity_np()
+#endif
+#include "priority.h"
+#include <ccore/log.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#if IBM
+#include <windows.h>
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Low in the SCHED_FIFO range: enough to preempt everything X-Plane runs, without getting in the
+// way of the audio or kernel threads that sit higher.
+#define FIFO_PRIORITY (10)
+
+enum {
+    STATUS_REALTIME = 1 << 0,
+    STATUS_PINNED = 1 << 1,
+};
+
+static struct {
+    bool realtime;
+    int cpu;
+
+    _Atomic int status;
+    _Atomic(const char *) error;
+} priority;
+
+void priority_configure(bool realtime, int cpu) {
+    priority.realtime = realtime;
+    priority.cpu = cpu;
+    atomic_store(&priority.status, 0);
+    atomic_store(&priority.error, NULL);
+}
+
+#if IBM
+
+static const char *set_realtime() {
+    return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)
+        ? NULL : "cannot raise thread priority";
+}
+
+static const char *set_cpu(int cpu) {
+    if(cpu >= (int)(8 * sizeof(DWORD_PTR))) return "no such CPU";
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu)
+        ? NULL : "cannot pin thread to CPU";
+}
+
+#else
+
+static const char *set_realtime() {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = FIFO_PRIORITY;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    // Usually EPERM: the user needs an rtprio limit (Linux) or to run X-Plane as root.
+    return err ? strerror(err) : NULL;
+}
+
+static const char *set_cpu(int cpu) {
+#if LIN
+    if(cpu >= CPU_SETSIZE) return "no such CPU";
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    return err ? strerror(err) : NULL;
+#else
+    (void)cpu;
+    return "CPU pinning is not available on macOS";
+#endif
+}
+
+#endif
+
+void priority_apply() {
+    int status = 0;
+    const char *error = NULL;
+
+    if(priority.realtime) {
+        const char *err = set_realtime();
+        if(err) {
+            CCWARN("cannot give the receive thread real-time priority: %s", err);
+            error = err;
+        } else {
+            status |= STATUS_REALTIME;
+        }
+    }
+    if(priority.cpu >= 0) {
+        const char *err = set_cpu(priority.cpu);
+        if(err) {
+            CCWARN("cannot pin the receive thread to CPU %d: %s", priority.cpu, err);
+            error = err;
+        } else {
+            status |= STATUS_PINNED;
+        }
+    }
+
+    atomic_store(&priority.error, error);
+    atomic_store(&priority.status, status);
+}
+
+htk_priority_t priority_status() {
+    int status = atomic_load(&priority.status);
+    htk_priority_t out = {
+        .is_realtime = (status & STATUS_REALTIME) != 0,
+        .is_pinned = (status & STATUS_PINNED) != 0,
+        .error = atomic_load(&priority.error),
+    };
+    return out;
+}
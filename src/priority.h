@@ -0,0 +1,34 @@
+//===--------------------------------------------------------------------------------------------===
+// priority.h - opt-in real-time scheduling and CPU pinning for the receive thread
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    bool is_realtime;       // the thread got the priority it asked for
+    bool is_pinned;         // the thread is pinned to the CPU it asked for
+    const char *error;      // why the last request was refused, or NULL
+} htk_priority_t;
+
+/// Sets what the next receive thread asks for. Sim thread, before the thread is started.
+void priority_configure(bool realtime, int cpu);
+
+/// Applies the configuration to the calling thread. Receive thread only. Failing is logged, and
+/// the thread carries on with the default scheduling.
+void priority_apply();
+
+/// What the running receive thread got. Any thread.
+htk_priority_t priority_status();
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,539 @@
+//===--------------------------------------------------------------------------------------------===
+// profiles.c - per-aircraft settings store, indexed by a hash of the .acf path
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include "profiles.h"
+#include <acfutils/assert.h>
+#include <acfutils/crc64.h>
+#include <acfutils/helpers.h>
+#include <acfutils/safe_alloc.h>
+#include <ccore/log.h>
+
+#include <ctype.h>
+#include <dirent.h> // mingw-w64 ships one too
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if IBM
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define PROFILE_NAME_LEN (16) // hex digits in a profile file name
+
+// profiles.bin is a straight dump of every profile, sorted by key, so it can be mapped and
+// searched in place. It is followed by the size and modification time of every JSON file the
+// profiles came from, including the ones that couldn't be parsed, also sorted by key. Any change
+// to the layout must bump SNAPSHOT_VERSION.
+#define SNAPSHOT_MAGIC "HTKPROF"
+#define SNAPSHOT_VERSION (4)
+#define SNAPSHOT_BYTE_ORDER (0x01020304u)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t record_size;
+    uint32_t count;
+    uint32_t source_count;
+    uint32_t reserved;
+    uint64_t checksum; // crc64 of the records and sources
+} snapshot_header_t;
+
+typedef struct {
+    uint64_t key;
+    float axes_sens[6];
+    float rotation_smooth;
+    float translation_smooth;
+    float input_smooth;
+    float ui_refresh_rate;
+    uint8_t axes_invert[6];
+    uint8_t ui_legacy_renderer;
+    uint8_t input_local;
+    int16_t rx_cpu;
+    uint8_t rx_realtime;
+    uint8_t reserved[5];
+} snapshot_record_t;
+
+typedef struct {
+    uint64_t key;
+    int64_t mtime;  // nanoseconds, -1 if the file was gone when the snapshot was written
+    int64_t size;
+} snapshot_source_t;
+
+_Static_assert(sizeof(snapshot_header_t) == 40, "snapshot header must not have padding");
+_Static_assert(sizeof(snapshot_record_t) == 64, "snapshot record must not have padding");
+_Static_assert(sizeof(snapshot_source_t) == 24, "snapshot source must not have padding");
+
+typedef struct {
+    uint64_t key;
+    bool persisted;
+    bool is_broken;     // the JSON file exists but couldn't be parsed: [settings] is unused
+    htk_settings_t settings;
+} profile_t;
+
+// Kept sorted by key. There are at most a few hundred of these, and lookups only happen when an
+// aircraft is loaded, so a binary search over a flat array is all we need.
+//
+// When a fresh snapshot is found at startup, lookups go straight to the mapped records instead,
+// and [items] stays empty until the first change, which copies everything out of the mapping.
+static struct {
+    char *plugin_dir;
+    char *system_dir;
+
+    profile_t *items;
+    size_t count;
+    size_t capacity;
+
+    struct {
+        const void *base;
+        size_t size;
+        const snapshot_record_t *records;
+        size_t count;
+        const snapshot_source_t *sources;
+        size_t source_count;
+#if IBM
+        HANDLE file;
+        HANDLE mapping;
+#endif
+    } map;
+} store;
+
+static void record_to_settings(const snapshot_record_t *rec, htk_settings_t *out) {
+    memset(out, 0, sizeof(*out));
+    for(int i = 0; i < 6; ++i) {
+        out->axes_sens[i] = rec->axes_sens[i];
+        out->axes_invert[i] = rec->axes_invert[i] != 0;
+    }
+    out->rotation_smooth = rec->rotation_smooth;
+    out->translation_smooth = rec->translation_smooth;
+    out->input_smooth = rec->input_smooth;
+    out->ui_refresh_rate = rec->ui_refresh_rate;
+    out->ui_legacy_renderer = rec->ui_legacy_renderer != 0;
+    out->input_local = rec->input_local != 0;
+    out->rx_realtime = rec->rx_realtime != 0;
+    out->rx_cpu = rec->rx_cpu;
+}
+
+static void settings_to_record(uint64_t key, const htk_settings_t *in, snapshot_record_t *rec) {
+    memset(rec, 0, sizeof(*rec));
+    rec->key = key;
+    for(int i = 0; i < 6; ++i) {
+        rec->axes_sens[i] = in->axes_sens[i];
+        rec->axes_invert[i] = in->axes_invert[i];
+    }
+    rec->rotation_smooth = in->rotation_smooth;
+    rec->translation_smooth = in->translation_smooth;
+    rec->input_smooth = in->input_smooth;
+    rec->ui_refresh_rate = in->ui_refresh_rate;
+    rec->ui_legacy_renderer = in->ui_legacy_renderer;
+    rec->input_local = in->input_local;
+    rec->rx_realtime = in->rx_realtime;
+    rec->rx_cpu = in->rx_cpu;
+}
+
+static void snapshot_unmap() {
+    if(!store.map.base) return;
+#if IBM
+    UnmapViewOfFile(store.map.base);
+    CloseHandle(store.map.mapping);
+    CloseHandle(store.map.file);
+#else
+    munmap((void *)store.map.base, store.map.size);
+#endif
+    memset(&store.map, 0, sizeof(store.map));
+}
+
+static bool snapshot_map(const char *path) {
+#if IBM
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(snapshot_header_t)) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    const void *base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!base) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    store.map.file = file;
+    store.map.mapping = mapping;
+    store.map.size = size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(snapshot_header_t)) {
+        close(fd);
+        return false;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) return false;
+    store.map.size = st.st_size;
+#endif
+    store.map.base = base;
+
+    const snapshot_header_t *header = base;
+    size_t body_size = store.map.size - sizeof(*header);
+    if(memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC))
+       || header->version != SNAPSHOT_VERSION
+       || header->byte_order != SNAPSHOT_BYTE_ORDER
+       || header->record_size != sizeof(snapshot_record_t)
+       || body_size != (size_t)header->count * sizeof(snapshot_record_t)
+                       + (size_t)header->source_count * sizeof(snapshot_source_t)) {
+        CCWARN("profile snapshot is from another version, ignoring it");
+        snapshot_unmap();
+        return false;
+    }
+
+    store.map.records = (const snapshot_record_t *)(header + 1);
+    store.map.count = header->count;
+    store.map.sources = (const snapshot_source_t *)(store.map.records + header->count);
+    store.map.source_count = header->source_count;
+    if(crc64(store.map.records, body_size) != header->checksum) {
+        CCWARN("profile snapshot is corrupt, ignoring it");
+        snapshot_unmap();
+        return false;
+    }
+    return true;
+}
+
+static const snapshot_record_t *snapshot_find(uint64_t key) {
+    size_t lo = 0, hi = store.map.count;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(store.map.records[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if(lo < store.map.count && store.map.records[lo].key == key) return &store.map.records[lo];
+    return NULL;
+}
+
+static const snapshot_source_t *snapshot_find_source(uint64_t key) {
+    size_t lo = 0, hi = store.map.source_count;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(store.map.sources[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if(lo < store.map.source_count && store.map.sources[lo].key == key) {
+        return &store.map.sources[lo];
+    }
+    return NULL;
+}
+
+static size_t lower_bound(uint64_t key) {
+    size_t lo = 0, hi = store.count;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(store.items[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static profile_t *slot_for(uint64_t key) {
+    size_t idx = lower_bound(key);
+    if(idx < store.count && store.items[idx].key == key) return &store.items[idx];
+
+    if(store.count == store.capacity) {
+        store.capacity = store.capacity ? store.capacity * 2 : 32;
+        store.items = safe_realloc(store.items, store.capacity * sizeof(profile_t));
+    }
+    memmove(&store.items[idx + 1], &store.items[idx], (store.count - idx) * sizeof(profile_t));
+    memset(&store.items[idx], 0, sizeof(profile_t));
+    store.items[idx].key = key;
+    store.count += 1;
+    return &store.items[idx];
+}
+
+static void put(uint64_t key, const htk_settings_t *settings, bool persisted) {
+    profile_t *profile = slot_for(key);
+    profile->persisted = persisted;
+    profile->is_broken = false;
+    profile->settings = *settings;
+}
+
+// Broken files are remembered so the snapshot can vouch for them too: otherwise a single typo
+// in one profile would have every startup parse the whole store again.
+static void put_broken(uint64_t key) {
+    profile_t *profile = slot_for(key);
+    profile->persisted = true;
+    profile->is_broken = true;
+}
+
+// The mapping is read-only, and Windows won't let us replace a mapped file, so the first change
+// moves everything into memory and lets the snapshot go.
+static void materialize() {
+    if(!store.map.base) return;
+    for(size_t i = 0; i < store.map.count; ++i) {
+        htk_settings_t settings;
+        record_to_settings(&store.map.records[i], &settings);
+        put(store.map.records[i].key, &settings, true);
+    }
+    for(size_t i = 0; i < store.map.source_count; ++i) {
+        uint64_t key = store.map.sources[i].key;
+        if(!snapshot_find(key)) put_broken(key);
+    }
+    snapshot_unmap();
+}
+
+void profiles_put(uint64_t key, const htk_settings_t *settings, bool persisted) {
+    materialize();
+    put(key, settings, persisted);
+}
+
+bool profiles_find(uint64_t key, htk_settings_t *out) {
+    if(store.map.base) {
+        const snapshot_record_t *rec = snapshot_find(key);
+        if(!rec) return false;
+        record_to_settings(rec, out);
+        return true;
+    }
+
+    size_t idx = lower_bound(key);
+    if(idx >= store.count || store.items[idx].key != key) return false;
+    if(store.items[idx].is_broken) return false;
+    *out = store.items[idx].settings;
+    return true;
+}
+
+void profiles_init(const char *plugin_dir, const char *system_dir) {
+    free(store.plugin_dir);
+    free(store.system_dir);
+    store.plugin_dir = safe_strdup(plugin_dir);
+    store.system_dir = safe_strdup(system_dir);
+}
+
+uint64_t profiles_key(const char *acf_path) {
+    ASSERT(store.system_dir);
+    const char *root = store.system_dir;
+    size_t root_len = strlen(root);
+    const char *rel = acf_path;
+    if(!strncmp(acf_path, root, root_len) && acf_path[root_len] == DIRSEP) {
+        rel = acf_path + root_len + 1;
+    }
+
+    // Hash the same key on every platform, so a profile folder can be shared.
+    char *norm = safe_strdup(rel);
+    for(char *c = norm; *c; ++c) {
+        if(*c == '\\') *c = '/';
+    }
+    uint64_t key = crc64(norm, strlen(norm));
+    free(norm);
+    return key != PROFILES_GLOBAL_KEY ? key : key + 1;
+}
+
+char *profiles_dir() {
+    ASSERT(store.plugin_dir);
+    return mkpathname(store.plugin_dir, "profiles", NULL);
+}
+
+char *profiles_path(uint64_t key) {
+    ASSERT(store.plugin_dir);
+    if(key == PROFILES_GLOBAL_KEY) return mkpathname(store.plugin_dir, "config.json", NULL);
+
+    char name[PROFILE_NAME_LEN + 8];
+    snprintf(name, sizeof(name), "%016" PRIx64 ".json", key);
+    return mkpathname(store.plugin_dir, "profiles", name, NULL);
+}
+
+char *profiles_snapshot_path() {
+    ASSERT(store.plugin_dir);
+    return mkpathname(store.plugin_dir, "profiles.bin", NULL);
+}
+
+static bool parse_name(const char *name, uint64_t *key) {
+    if(strlen(name) != PROFILE_NAME_LEN + 5) return false;
+    if(strcmp(name + PROFILE_NAME_LEN, ".json")) return false;
+    for(int i = 0; i < PROFILE_NAME_LEN; ++i) {
+        if(!isxdigit((unsigned char)name[i])) return false;
+    }
+    *key = strtoull(name, NULL, 16);
+    return true;
+}
+
+static void clear() {
+    snapshot_unmap();
+    free(store.items);
+    store.items = NULL;
+    store.count = store.capacity = 0;
+}
+
+// Modification time in nanoseconds and size, or an mtime of -1 if the file doesn't exist.
+// Windows only gives us whole seconds, which is why the size is compared too.
+static void file_stamp(const char *path, snapshot_source_t *out) {
+    struct stat st;
+    out->mtime = -1;
+    out->size = 0;
+    if(stat(path, &st) != 0) return;
+    int64_t nsec = 0;
+#if LIN
+    nsec = st.st_mtim.tv_nsec;
+#elif APL
+    nsec = st.st_mtimespec.tv_nsec;
+#endif
+    out->mtime = (int64_t)st.st_mtime * 1000000000 + nsec;
+    out->size = st.st_size;
+}
+
+typedef void (*source_fn_t)(uint64_t key, const char *path, void *refcon);
+
+// Calls [fn] for config.json and every JSON profile in the store.
+static void each_source(source_fn_t fn, void *refcon) {
+    char *global = profiles_path(PROFILES_GLOBAL_KEY);
+    if(file_exists(global, NULL)) fn(PROFILES_GLOBAL_KEY, global, refcon);
+    free(global);
+
+    char *dir_path = profiles_dir();
+    DIR *dir = opendir(dir_path);
+    if(dir) {
+        struct dirent *entry = NULL;
+        while((entry = readdir(dir)) != NULL) {
+            uint64_t key = 0;
+            if(!parse_name(entry->d_name, &key)) continue;
+            char *path = mkpathname(dir_path, entry->d_name, NULL);
+            fn(key, path, refcon);
+            free(path);
+        }
+        closedir(dir);
+    }
+    free(dir_path);
+}
+
+typedef struct {
+    size_t count;
+    bool is_stale;
+} freshness_t;
+
+// A source is fresh if it is still exactly the file the snapshot was written after.
+static void check_source(uint64_t key, const char *path, void *refcon) {
+    freshness_t *check = refcon;
+    check->count += 1;
+
+    const snapshot_source_t *known = snapshot_find_source(key);
+    snapshot_source_t stamp;
+    file_stamp(path, &stamp);
+    if(!known || known->mtime != stamp.mtime || known->size != stamp.size) check->is_stale = true;
+}
+
+static void load_source(uint64_t key, const char *path, void *refcon) {
+    profile_parse_fn_t parse = (profile_parse_fn_t)refcon;
+    htk_settings_t settings;
+    if(parse(path, &settings)) {
+        put(key, &settings, true);
+    } else {
+        put_broken(key);
+    }
+}
+
+bool profiles_load(profile_parse_fn_t parse) {
+    ASSERT(parse);
+    clear();
+
+    // Checking the snapshot against its sources only takes a directory listing and a stat per
+    // file, which is a lot cheaper than parsing them all.
+    char *snapshot = profiles_snapshot_path();
+    freshness_t check = {.count = 0, .is_stale = false};
+    if(snapshot_map(snapshot)) {
+        each_source(check_source, &check);
+        if(!check.is_stale && check.count == store.map.source_count) {
+            CCINFO("loaded %zu profiles from `%s`", store.map.count, snapshot);
+            free(snapshot);
+            return false;
+        }
+        snapshot_unmap();
+    }
+    free(snapshot);
+
+    each_source(load_source, (void *)parse);
+    CCINFO("loaded %zu profiles", store.count);
+    return true;
+}
+
+void *profiles_snapshot(size_t *size) {
+    ASSERT(size);
+    materialize();
+
+    size_t count = 0, source_count = 0;
+    for(size_t i = 0; i < store.count; ++i) {
+        if(!store.items[i].persisted) continue;
+        source_count += 1;
+        if(!store.items[i].is_broken) count += 1;
+    }
+
+    *size = sizeof(snapshot_header_t) + count * sizeof(snapshot_record_t)
+          + source_count * sizeof(snapshot_source_t);
+    char *data = safe_calloc(1, *size);
+    snapshot_header_t *header = (snapshot_header_t *)data;
+    snapshot_record_t *records = (snapshot_record_t *)(header + 1);
+    snapshot_source_t *sources = (snapshot_source_t *)(records + count);
+
+    size_t idx = 0, source_idx = 0;
+    for(size_t i = 0; i < store.count; ++i) {
+        if(!store.items[i].persisted) continue;
+        sources[source_idx].key = store.items[i].key;
+        sources[source_idx].mtime = -1;
+        source_idx += 1;
+        if(store.items[i].is_broken) continue;
+        settings_to_record(store.items[i].key, &store.items[i].settings, &records[idx++]);
+    }
+
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header->version = SNAPSHOT_VERSION;
+    header->byte_order = SNAPSHOT_BYTE_ORDER;
+    header->record_size = sizeof(snapshot_record_t);
+    header->count = count;
+    header->source_count = source_count;
+    return data;
+}
+
+void profiles_snapshot_stamp(void *snapshot, size_t size) {
+    ASSERT(snapshot);
+    ASSERT(size >= sizeof(snapshot_header_t));
+    snapshot_header_t *header = snapshot;
+    snapshot_record_t *records = (snapshot_record_t *)(header + 1);
+    snapshot_source_t *sources = (snapshot_source_t *)(records + header->count);
+
+    for(size_t i = 0; i < header->source_count; ++i) {
+        char *path = profiles_path(sources[i].key);
+        file_stamp(path, &sources[i]);
+        free(path);
+    }
+    header->checksum = crc64(records, size - sizeof(*header));
+}
+
+void profiles_cleanup() {
+    clear();
+    free(store.plugin_dir);
+    free(store.system_dir);
+    store.plugin_dir = store.system_dir = NULL;
+}
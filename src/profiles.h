@@ -0,0 +1,69 @@
+//===--------------------------------------------------------------------------------------------===
+// profiles.h - per-aircraft settings store, indexed by a hash of the .acf path
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include "htrack.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// The global settings (config.json) are kept in the store under this key.
+#define PROFILES_GLOBAL_KEY (0)
+
+typedef bool (*profile_parse_fn_t)(const char *path, htk_settings_t *out);
+
+/// Sets the directories the store works from. Everything below only uses these copies, so the
+/// store doesn't depend on XPLM and can be loaded from a background thread.
+void profiles_init(const char *plugin_dir, const char *system_dir);
+
+/// Loads the global settings and every profile in the store. If profiles.bin was written after
+/// the JSON files as they are now, it is mapped and used as is. Otherwise each file is loaded
+/// with [parse], and this returns true to signal that the snapshot should be written again.
+///
+/// Nothing else may touch the store while this runs.
+bool profiles_load(profile_parse_fn_t parse);
+
+/// Frees the in-memory profiles and the directories given to profiles_init().
+void profiles_cleanup();
+
+/// Returns the key of the aircraft at [acf_path]. Paths are hashed relative to the X-Plane root,
+/// so moving the sim install doesn't lose profiles.
+uint64_t profiles_key(const char *acf_path);
+
+/// Returns the directory profiles are stored in. The caller owns the string.
+char *profiles_dir();
+
+/// Returns the path of the profile file for [key]. The caller owns the string.
+char *profiles_path(uint64_t key);
+
+/// Returns the path of the binary snapshot. The caller owns the string.
+char *profiles_snapshot_path();
+
+/// Serialises every persisted profile into a snapshot, to be written to profiles_snapshot_path().
+/// The caller owns the returned buffer.
+void *profiles_snapshot(size_t *size);
+
+/// Records what the JSON files behind [snapshot] look like now. Call it right before writing the
+/// snapshot, once the files themselves are written. Only touches the disk and [snapshot], so it
+/// can run on the worker thread.
+void profiles_snapshot_stamp(void *snapshot, size_t size);
+
+/// Copies the profile for [key] into [out], if there is one. Never touches the disk.
+bool profiles_find(uint64_t key, htk_settings_t *out);
+
+/// Adds or replaces the in-memory profile for [key]. Profiles that don't have a JSON file in the
+/// store ([persisted] is false) are left out of the snapshot.
+void profiles_put(uint64_t key, const htk_settings_t *settings, bool persisted);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,127 @@
+//===--------------------------------------------------------------------------------------------===
+// publish.c - shared-memory publication of the tracked pose, for other processes
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include "publish.h"
+#include <acfutils/log.h>
+#include <acfutils/time.h>
+
+#if IBM
+
+void publish_start() {
+}
+
+void publish_stop() {
+}
+
+void publish_frame(publish_state_t state,
+                   uint64_t input_time,
+                   const double input[6],
+                   const double output[6],
+                   const double viewpoint[3]) {
+    UNUSED(state);
+    UNUSED(input_time);
+    UNUSED(input);
+    UNUSED(output);
+    UNUSED(viewpoint);
+}
+
+#else
+#include <htrack/shm.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static struct {
+    htk_shm_output_t *shm;
+    uint64_t frame;
+} publish;
+
+static uint64_t monotonic_usec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void publish_start() {
+    if(publish.shm) return;
+
+    // Readers are often other users' services (motion platforms, recorders), so the segment is
+    // world-readable. Only HeadTrack writes to it.
+    shm_unlink(HTK_SHM_OUTPUT_NAME);
+    int fd = shm_open(HTK_SHM_OUTPUT_NAME, O_RDWR | O_CREAT | O_EXCL,
+                      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if(fd < 0 || ftruncate(fd, sizeof(htk_shm_output_t))) {
+        logMsg("unable to create shared memory output: %s", strerror(errno));
+        if(fd >= 0) {
+            close(fd);
+            shm_unlink(HTK_SHM_OUTPUT_NAME);
+        }
+        return;
+    }
+
+    void *mem = mmap(NULL, sizeof(htk_shm_output_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED) {
+        logMsg("unable to map shared memory output: %s", strerror(errno));
+        shm_unlink(HTK_SHM_OUTPUT_NAME);
+        return;
+    }
+
+    publish.shm = mem;
+    publish.frame = 0;
+    publish.shm->version = HTK_SHM_OUTPUT_VERSION;
+    __atomic_store_n(&publish.shm->magic, HTK_SHM_OUTPUT_MAGIC, __ATOMIC_RELEASE);
+    logMsg("publishing head pose to shared memory at %s", HTK_SHM_OUTPUT_NAME);
+}
+
+void publish_stop() {
+    if(!publish.shm) return;
+    __atomic_store_n(&publish.shm->is_closed, 1, __ATOMIC_RELAXED);
+    shm_unlink(HTK_SHM_OUTPUT_NAME);
+    munmap(publish.shm, sizeof(htk_shm_output_t));
+    publish.shm = NULL;
+}
+
+void publish_frame(publish_state_t state,
+                   uint64_t input_time,
+                   const double input[6],
+                   const double output[6],
+                   const double viewpoint[3]) {
+    if(!publish.shm) return;
+
+    uint32_t flags = 0;
+    if(state.is_enabled) flags |= HTK_SHM_ENABLED;
+    if(state.is_active) flags |= HTK_SHM_ACTIVE;
+    if(state.is_local_input) flags |= HTK_SHM_LOCAL_INPUT;
+
+    // microclock() isn't necessarily monotonic, but it's fine for measuring how old the input is.
+    uint64_t now = monotonic_usec();
+    uint64_t age = input_time ? microclock() - input_time : 0;
+
+    htk_shm_frame_t *frame = &publish.shm->frame;
+    uint32_t seq = publish.shm->seq;
+    __atomic_store_n(&publish.shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    publish.frame += 1;
+    __atomic_store_n(&frame->frame, publish.frame, __ATOMIC_RELAXED);
+    __atomic_store_n(&frame->time, now, __ATOMIC_RELAXED);
+    __atomic_store_n(&frame->input_time, input_time && age < now ? now - age : 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&frame->flags, flags, __ATOMIC_RELAXED);
+    for(int i = 0; i < 6; ++i) {
+        __atomic_store(&frame->input[i], &input[i], __ATOMIC_RELAXED);
+        __atomic_store(&frame->output[i], &output[i], __ATOMIC_RELAXED);
+    }
+    for(int i = 0; i < 3; ++i) {
+        __atomic_store(&frame->viewpoint[i], &viewpoint[i], __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&publish.shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,41 @@
+//===--------------------------------------------------------------------------------------------===
+// publish.h - shared-memory publication of the tracked pose, for other processes
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Creates the output segment described in include/htrack/shm.h. HeadTrack works without it, so
+/// failing only logs. Not available on Windows.
+void publish_start();
+
+/// Marks the segment as closed for readers, and removes it.
+void publish_stop();
+
+/// What the plugin was doing during a frame. Readers see these as HTK_SHM_* flags.
+typedef struct {
+    bool is_enabled;
+    bool is_active;
+    bool is_local_input;
+} publish_state_t;
+
+/// Publishes one frame. [input_time] is when [input] was received, as a microclock() time. Sim
+/// thread only.
+void publish_frame(publish_state_t state,
+                   uint64_t input_time,
+                   const double input[6],
+                   const double output[6],
+                   const double viewpoint[3]);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -8,17 +8,37 @@
 //===--------------------------------------------------------------------------------------------===
 #include "htrack.h"
 #include "paths.h"
+#include "profiles.h"
+#include "watcher.h"
+#include "worker.h"
 #include <stdio.h>
 #include <jsmn/jsmn_path.h>
 
 #include <acfutils/helpers.h>
 #include <acfutils/log.h>
 #include <acfutils/safe_alloc.h>
+#include <acfutils/thread.h>
+#include <ccore/alloc.h>
+#include <ccore/log.h>
 
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <setjmp.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if IBM
+#include <windows.h>
+#include <io.h>
+#endif
 
 jmp_buf exc;
 const char *exc_msg;
@@ -29,7 +49,12 @@ static const htk_settings_t defaults = {
     .axes_sens = {2, 2, 2, 2, 2, 0.5},
     .rotation_smooth = .5f,
     .translation_smooth = .5f,
-    .input_smooth = .5f
+    .input_smooth = .5f,
+    .input_local = false,
+    .rx_realtime = false,
+    .rx_cpu = -1,
+    .ui_refresh_rate = 30.f,
+    .ui_legacy_renderer = false
 };
 
 static const char *axes_sensitivity_name[] = {
@@ -42,175 +67,830 @@ static const char *axes_reverse_name[] = {
     "yaw_reversed", "pitch_reversed", "roll_reversed",
 };
 
-static bool as_number(const char *json, const jsmntok_t *tok, float *out) {
-    
-    if(tok->type != JSMN_PRIMITIVE) return false;
-    if(json[tok->start] != '+' && json[tok->start] != '-' && !isdigit(json[tok->start])) return false;
-    
-    *out = atof(&json[tok->start]);
-    return true;
+// The settings file layout, as a flat table of `section/key` entries. The loader walks the token
+// stream once and looks each key up here, instead of searching the whole token array per field.
+typedef enum {
+    FIELD_NUMBER,
+    FIELD_INT,
+    FIELD_BOOL,
+} field_type_t;
+
+typedef struct {
+    const char *section;
+    const char *key;
+    field_type_t type;
+    size_t offset;
+    bool required;
+    float min, max;
+} field_t;
+
+#define AXIS_FIELDS(i, sens, rev) \
+    {"axes", sens, FIELD_NUMBER, offsetof(htk_settings_t, axes_sens[i]), true, 0.01f, 100.f}, \
+    {"axes", rev, FIELD_BOOL, offsetof(htk_settings_t, axes_invert[i]), true, 0, 0}
+
+static const field_t schema[] = {
+    AXIS_FIELDS(0, "x_sensitivity", "x_reversed"),
+    AXIS_FIELDS(1, "y_sensitivity", "y_reversed"),
+    AXIS_FIELDS(2, "z_sensitivity", "z_reversed"),
+    AXIS_FIELDS(3, "yaw_sensitivity", "yaw_reversed"),
+    AXIS_FIELDS(4, "pitch_sensitivity", "pitch_reversed"),
+    AXIS_FIELDS(5, "roll_sensitivity", "roll_reversed"),
+    {"smoothing", "input_smoothing", FIELD_NUMBER, offsetof(htk_settings_t, input_smooth), true, 0.f, 1.f},
+    {"smoothing", "exp_rotation", FIELD_NUMBER, offsetof(htk_settings_t, rotation_smooth), true, 0.f, 1.f},
+    {"smoothing", "exp_translation", FIELD_NUMBER, offsetof(htk_settings_t, translation_smooth), true, 0.f, 1.f},
+    // Added after the first release, so older files won't have them: keep the defaults.
+    {"interface", "refresh_rate", FIELD_NUMBER, offsetof(htk_settings_t, ui_refresh_rate), false, 5.f, 60.f},
+    {"interface", "legacy_renderer", FIELD_BOOL, offsetof(htk_settings_t, ui_legacy_renderer), false, 0, 0},
+    {"input", "shared_memory", FIELD_BOOL, offsetof(htk_settings_t, input_local), false, 0, 0},
+    {"input", "realtime", FIELD_BOOL, offsetof(htk_settings_t, rx_realtime), false, 0, 0},
+    {"input", "cpu", FIELD_INT, offsetof(htk_settings_t, rx_cpu), false, -1, 1023},
+};
+#define SCHEMA_COUNT ARRAY_NUM_ELEM(schema)
+_Static_assert(SCHEMA_COUNT <= 32, "field bitmask is a uint32_t");
+
+typedef struct {
+    const char *json;
+    const jsmntok_t *toks;
+    int count;
+    uint32_t seen;
+    htk_settings_t *out;
+} loader_t;
+
+static bool tok_equals(const char *json, const jsmntok_t *tok, const char *str) {
+    size_t len = tok->end - tok->start;
+    return tok->type == JSMN_STRING && strlen(str) == len && !strncmp(json + tok->start, str, len);
 }
 
-static bool as_bool(const char *json, const jsmntok_t *tok, bool *out) {
-    
+// Returns the index of the first token after the value at [i] and all of its children.
+static int skip_value(const loader_t *l, int i) {
+    ASSERT(i < l->count);
+    const jsmntok_t *tok = &l->toks[i++];
+    if(tok->type == JSMN_OBJECT) {
+        for(int j = 0; j < tok->size && i < l->count; ++j) i = skip_value(l, i + 1);
+    } else if(tok->type == JSMN_ARRAY) {
+        for(int j = 0; j < tok->size && i < l->count; ++j) i = skip_value(l, i);
+    }
+    return i;
+}
+
+static bool read_field(loader_t *l, const field_t *field, const jsmntok_t *tok) {
+    const char *str = l->json + tok->start;
+    void *dest = (char *)l->out + field->offset;
+
     if(tok->type != JSMN_PRIMITIVE) return false;
-    if(json[tok->start] != 't' && json[tok->start] != 'f') return false;
-    
-    *out = (json[tok->start] == 't');
-    return true;
+    switch(field->type) {
+    case FIELD_BOOL:
+        if(*str != 't' && *str != 'f') return false;
+        *(bool *)dest = (*str == 't');
+        return true;
+
+    case FIELD_NUMBER: {
+        char *end = NULL;
+        double val = strtod(str, &end);
+        if(end != l->json + tok->end || !isfinite(val)) return false;
+        if(val < field->min || val > field->max) return false;
+        *(float *)dest = val;
+        return true;
+    }
+
+    case FIELD_INT: {
+        char *end = NULL;
+        long val = strtol(str, &end, 10);
+        if(end != l->json + tok->end) return false;
+        if(val < field->min || val > field->max) return false;
+        *(int *)dest = (int)val;
+        return true;
+    }
+    }
+    return false;
 }
 
-static bool get_number(const char *json, const jsmntok_t *toks, int count, const char *path, float *out) {
-    const jsmntok_t *tok = jsmn_path_lookup(json, toks, count, path);
-    if(!tok) return false;
-    return as_number(json, tok, out);
+static int load_section(loader_t *l, int i, const jsmntok_t *section) {
+    const jsmntok_t *obj = &l->toks[i++];
+    for(int pair = 0; pair < obj->size && i + 1 < l->count; ++pair) {
+        const jsmntok_t *key = &l->toks[i];
+        const jsmntok_t *val = &l->toks[i + 1];
+
+        for(size_t f = 0; f < SCHEMA_COUNT; ++f) {
+            const field_t *field = &schema[f];
+            if(!tok_equals(l->json, section, field->section)) continue;
+            if(!tok_equals(l->json, key, field->key)) continue;
+
+            if(read_field(l, field, val)) {
+                l->seen |= 1u << f;
+            } else {
+                CCWARN("bad value for '%s/%s'", field->section, field->key);
+            }
+            break;
+        }
+        i = skip_value(l, i + 1);
+    }
+    return i;
 }
 
-static void settings_load_from(const char *path) {
-    
-    size_t size = 0;
-    char *json = file2buf(path, &size);
-    if(!json) {
-        logMsg("configuration error: cannot open %s", path);
-        return;
+static bool load_root(loader_t *l) {
+    if(l->count < 1 || l->toks[0].type != JSMN_OBJECT) {
+        CCWARN("config error: expected an object at the top level");
+        return false;
     }
-    logMsg("loading settings from `%s`", path);
-    
+
+    int i = 1;
+    for(int pair = 0; pair < l->toks[0].size && i + 1 < l->count; ++pair) {
+        const jsmntok_t *section = &l->toks[i];
+        if(l->toks[i + 1].type == JSMN_OBJECT) {
+            i = load_section(l, i + 1, section);
+        } else {
+            i = skip_value(l, i + 1);
+        }
+    }
+
+    bool ok = true;
+    for(size_t f = 0; f < SCHEMA_COUNT; ++f) {
+        if(!schema[f].required || (l->seen & (1u << f))) continue;
+        CCWARN("missing or bad value for '%s/%s'", schema[f].section, schema[f].key);
+        ok = false;
+    }
+    return ok;
+}
+
+// jsmn keeps its position when it runs out of tokens, so we can grow the array and carry on.
+static jsmntok_t *tokenize(const char *json, size_t size, int *count) {
     jsmn_parser parser;
-    jsmntok_t toks[128];
-    
+    int capacity = 128;
+    jsmntok_t *toks = safe_malloc(capacity * sizeof(*toks));
+
     jsmn_init(&parser);
-    int n_toks = jsmn_parse(&parser, json, size, toks, ARRAY_NUM_ELEM(toks));
-    
-    if(n_toks < 0) {
-        logMsg("config error: invalid JSON file");
-        goto errout;
-    }
-    
-    for(int i = 0; i < 6; ++i) {
-        const jsmntok_t *sens = jsmn_path_lookup_format(json, toks, n_toks,
-            "axes/%s", axes_sensitivity_name[i]);
-        const jsmntok_t *invert = jsmn_path_lookup_format(json, toks, n_toks,
-            "axes/%s", axes_reverse_name[i]);
-            
-        if(!sens || !as_number(json, sens, &htk_settings.axes_sens[i])) {
-            logMsg("missing or bad value for '%s'", axes_sensitivity_name[i]);
-            goto errout;
+    for(;;) {
+        int n = jsmn_parse(&parser, json, size, toks, capacity);
+        if(n >= 0) {
+            *count = n;
+            return toks;
         }
-        
-        if(!invert || !as_bool(json, invert, &htk_settings.axes_invert[i])) {
-            logMsg("missing or bad value for '%s'", axes_reverse_name[i]);
-            goto errout;
+        if(n != JSMN_ERROR_NOMEM) {
+            free(toks);
+            return NULL;
         }
+        capacity *= 2;
+        toks = safe_realloc(toks, capacity * sizeof(*toks));
+    }
+}
+
+// Parses [path] into [out], which is left untouched unless the whole file is valid. Only touches
+// the persisted fields and logs through ccore, so this is safe to call off the sim thread with a
+// staging copy.
+static bool settings_parse(const char *path, htk_settings_t *out) {
+    
+    size_t size = 0;
+    char *json = file2buf(path, &size);
+    if(!json) {
+        CCWARN("configuration error: cannot open %s", path);
+        return false;
     }
+    CCINFO("loading settings from `%s`", path);
     
-    if(!get_number(json, toks, n_toks,
-        "smoothing/input_smoothing", &htk_settings.input_smooth)) goto errout;
-    if(!get_number(json, toks, n_toks,
-        "smoothing/exp_rotation", &htk_settings.rotation_smooth)) goto errout;
-    if(!get_number(json, toks, n_toks,
-        "smoothing/exp_translation", &htk_settings.translation_smooth)) goto errout;
-errout:
+    int count = 0;
+    jsmntok_t *toks = tokenize(json, size, &count);
+    if(!toks) {
+        CCWARN("config error: invalid JSON file");
+        free(json);
+        return false;
+    }
+
+    htk_settings_t loaded = defaults;
+    loader_t loader = {.json = json, .toks = toks, .count = count, .seen = 0, .out = &loaded};
+    bool ok = load_root(&loader);
+    if(ok) *out = loaded;
+
+    free(toks);
     free(json);
-    return;
+    return ok;
 }
 
-void settings_load_global() {
-    char *path = mkpathname(xpath_plugin(), "config.json", NULL);
-    if(file_exists(path, NULL)) {
-        settings_load_from(path);
+// Copies the persisted fields of [from] into the live settings. Sim thread only.
+// The input source and receive thread settings are left alone: they depend on the computer, not
+// the aircraft, so they only ever come from the global settings, through machine_apply().
+static void settings_apply(const htk_settings_t *from) {
+    memcpy(htk_settings.axes_sens, from->axes_sens, sizeof(htk_settings.axes_sens));
+    memcpy(htk_settings.axes_invert, from->axes_invert, sizeof(htk_settings.axes_invert));
+    htk_settings.rotation_smooth = from->rotation_smooth;
+    htk_settings.translation_smooth = from->translation_smooth;
+    htk_settings.input_smooth = from->input_smooth;
+    htk_settings.ui_refresh_rate = from->ui_refresh_rate;
+    htk_settings.ui_legacy_renderer = from->ui_legacy_renderer;
+}
+
+static void machine_apply(const htk_settings_t *from) {
+    htk_settings.input_local = from->input_local;
+    htk_settings.rx_realtime = from->rx_realtime;
+    htk_settings.rx_cpu = from->rx_cpu;
+}
+
+typedef struct {
+    bool is_stale;
+} store_job_t;
+
+typedef struct {
+    unsigned generation;
+    uint64_t key;
+    char *path;
+    bool found;
+    htk_settings_t settings;
+} legacy_job_t;
+
+// Settings are serialised into memory on the sim thread, then handed over to the worker thread
+// which writes them to a temporary file and renames it over the old one, so a crash mid-write
+// never leaves a truncated config behind.
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+    int level;
+} json_buf_t;
+
+typedef struct {
+    char *path;
+    char *dir; // created before writing, if not NULL
+    int source; // settings_source_t the file is watched as, or -1
+    json_buf_t json;
+    bool ok;
+    char error[256];
+} save_job_t;
+
+// Jobs are created and finished on the sim thread, so their records come out of a pool that only
+// it touches, the same way the worker's own queue entries do. The JSON buffer of the last save
+// is kept for the next one, so steady-state saves don't grow a new one either.
+typedef union {
+    store_job_t store;
+    legacy_job_t legacy;
+    save_job_t save;
+} any_job_t;
+
+#define JOB_CHUNK_SIZE (8)
+
+static struct {
+    ccfixed_t pool;
+    json_buf_t spare;
+} jobs;
+
+static void *job_alloc() {
+    any_job_t *job = ccfixed_alloc(&jobs.pool);
+    memset(job, 0, sizeof(*job));
+    return job;
+}
+
+static void job_free(void *job) {
+    ccfixed_free(&jobs.pool, job);
+}
+
+// Hands out the spare serialisation buffer, emptied.
+static json_buf_t buf_take() {
+    json_buf_t buf = jobs.spare;
+    memset(&jobs.spare, 0, sizeof(jobs.spare));
+    buf.size = 0;
+    buf.level = 0;
+    return buf;
+}
+
+// Keeps the larger of [buf] and the current spare around for the next save.
+static void buf_give_back(json_buf_t *buf) {
+    if(buf->capacity > jobs.spare.capacity) {
+        free(jobs.spare.data);
+        jobs.spare = *buf;
     } else {
-        logMsg("no global settings found, using defaults");
-        htk_settings = defaults;
+        free(buf->data);
     }
-    free(path);
-    htk_settings_did_update();
+    memset(buf, 0, sizeof(*buf));
 }
 
-bool settings_load_plane() {
-    char *path = mkpathname(xpath_aircraft(), "htrack.json", NULL);
-    if(!file_exists(path, NULL)) {
-        logMsg("no plane-specific settings found");
-        free(path);
-        return false;
+// The watcher thread keeps an eye on both settings files. When one changes, it is parsed on the
+// watcher thread into a staging copy, and the sim thread swaps it in at the next frame.
+typedef enum {
+    SOURCE_GLOBAL,
+    SOURCE_PLANE,
+    SOURCE_COUNT
+} settings_source_t;
+
+// What a file looked like on disk. Our own saves record the stamp of the file they wrote, so the
+// watcher can tell them apart from edits made by someone else.
+typedef struct {
+    bool exists;
+    int64_t size;
+    int64_t mtime;
+    long mtime_nsec;
+} file_stamp_t;
+
+static struct {
+    settings_source_t active;
+    uint64_t plane_key;
+
+    mutex_t mtx;
+    bool has_staged[SOURCE_COUNT];
+    htk_settings_t staged[SOURCE_COUNT];
+    file_stamp_t written[SOURCE_COUNT];
+    atomic_bool is_dirty;
+} reload;
+
+static void stamp_read(const char *path, file_stamp_t *out) {
+    struct stat st;
+    memset(out, 0, sizeof(*out));
+    if(stat(path, &st) != 0) return;
+
+    out->exists = true;
+    out->size = st.st_size;
+    out->mtime = st.st_mtime;
+#if LIN
+    out->mtime_nsec = st.st_mtim.tv_nsec;
+#elif APL
+    out->mtime_nsec = st.st_mtimespec.tv_nsec;
+#endif
+}
+
+static bool stamp_equal(const file_stamp_t *a, const file_stamp_t *b) {
+    return a->exists == b->exists
+        && a->size == b->size
+        && a->mtime == b->mtime
+        && a->mtime_nsec == b->mtime_nsec;
+}
+
+// Everything that touches the disk happens on the worker thread: the store is loaded there at
+// startup, and aircraft folders are only read there. The sim thread only ever picks settings
+// from memory once they're ready.
+static struct {
+    bool profiles_ready;
+    bool plane_pending;     // a plane was loaded before the store was ready
+    unsigned generation;    // bumped on every plane load, to drop stale aircraft folder reads
+
+    // Saves made before the store was ready, put in it once it is. Only the latest aircraft is
+    // kept: the store loads in the first moments of the session.
+    bool has_early[SOURCE_COUNT];
+    uint64_t early_key[SOURCE_COUNT];
+    htk_settings_t early[SOURCE_COUNT];
+} loading;
+
+static void snapshot_save();
+
+static void file_did_change(int slot, const char *path, void *refcon) {
+    UNUSED(refcon);
+    ASSERT(slot >= 0 && slot < SOURCE_COUNT);
+
+    // settings_save() already put what it wrote in the store, and the settings may have moved on
+    // since: reading our own file back would only undo that.
+    file_stamp_t stamp;
+    stamp_read(path, &stamp);
+    mutex_enter(&reload.mtx);
+    bool is_ours = stamp.exists && stamp_equal(&stamp, &reload.written[slot]);
+    mutex_exit(&reload.mtx);
+    if(is_ours) return;
+
+    htk_settings_t loaded;
+    if(!settings_parse(path, &loaded)) {
+        CCWARN("ignoring changes to `%s`", path);
+        return;
     }
-    settings_load_from(path);
-    free(path);
+
+    mutex_enter(&reload.mtx);
+    reload.staged[slot] = loaded;
+    reload.has_staged[slot] = true;
+    atomic_store(&reload.is_dirty, true);
+    mutex_exit(&reload.mtx);
+}
+
+void settings_watch_start() {
+    mutex_init(&reload.mtx);
+    reload.active = SOURCE_GLOBAL;
+    reload.has_staged[SOURCE_GLOBAL] = reload.has_staged[SOURCE_PLANE] = false;
+    memset(reload.written, 0, sizeof(reload.written));
+    atomic_store(&reload.is_dirty, false);
+    ccfixed_init(&jobs.pool, sizeof(any_job_t), JOB_CHUNK_SIZE);
+    memset(&jobs.spare, 0, sizeof(jobs.spare));
+    watcher_start(file_did_change, NULL);
+}
+
+// The worker must be stopped first: its completions give job records back to the pool.
+void settings_watch_stop() {
+    watcher_stop();
+    mutex_destroy(&reload.mtx);
+    free(jobs.spare.data);
+    memset(&jobs.spare, 0, sizeof(jobs.spare));
+    ccfixed_deinit(&jobs.pool);
+}
+
+bool settings_poll_reload() {
+    // Changes stay staged until the store has finished loading.
+    if(!loading.profiles_ready) return false;
+    if(!atomic_load(&reload.is_dirty)) return false;
+
+    bool has_staged[SOURCE_COUNT];
+    htk_settings_t staged[SOURCE_COUNT];
+
+    mutex_enter(&reload.mtx);
+    memcpy(has_staged, reload.has_staged, sizeof(has_staged));
+    memcpy(staged, reload.staged, sizeof(staged));
+    reload.has_staged[SOURCE_GLOBAL] = reload.has_staged[SOURCE_PLANE] = false;
+    atomic_store(&reload.is_dirty, false);
+    mutex_exit(&reload.mtx);
+
+    if(has_staged[SOURCE_GLOBAL]) profiles_put(PROFILES_GLOBAL_KEY, &staged[SOURCE_GLOBAL], true);
+    if(has_staged[SOURCE_PLANE]) profiles_put(reload.plane_key, &staged[SOURCE_PLANE], true);
+    snapshot_save();
+
+    // A plane file showing up mid-flight takes over, same as it would have on plane load.
+    if(has_staged[SOURCE_PLANE]) {
+        reload.active = SOURCE_PLANE;
+        settings_apply(&staged[SOURCE_PLANE]);
+    } else if(has_staged[SOURCE_GLOBAL] && reload.active == SOURCE_GLOBAL) {
+        settings_apply(&staged[SOURCE_GLOBAL]);
+    }
+    // The global file still has the last word on those, whichever profile is in use.
+    if(has_staged[SOURCE_GLOBAL]) machine_apply(&staged[SOURCE_GLOBAL]);
+    if(!has_staged[SOURCE_PLANE] && !has_staged[SOURCE_GLOBAL]) return false;
+
+    logMsg("settings reloaded from %s file", has_staged[SOURCE_PLANE] ? "aircraft" : "global");
+    htk_settings_did_update();
     return true;
 }
 
-static int level = 0;
+// Changes staged for the file we're about to load from scratch are stale.
+static void watch_source(settings_source_t source, const char *path) {
+    watcher_set_path(source, path);
+    mutex_enter(&reload.mtx);
+    reload.has_staged[source] = false;
+    mutex_exit(&reload.mtx);
+}
 
-static void indent(FILE *f) {
-    for(int i = 0; i < level; ++i) {
-        fprintf(f, "  ");
+static void use_global() {
+    htk_settings_t loaded;
+    if(loading.profiles_ready && profiles_find(PROFILES_GLOBAL_KEY, &loaded)) {
+        settings_apply(&loaded);
+    } else {
+        settings_apply(&defaults);
     }
+    reload.active = SOURCE_GLOBAL;
+    htk_settings_did_update();
 }
 
-static void start_obj(FILE *f, const char *name) {
-    if(!name) {
-        indent(f);
-        fprintf(f, "{\n");
+// Unlike the rest, the input settings aren't reset on every plane load, or unsaved changes would
+// be undone and the input source restarted for nothing.
+static void use_machine() {
+    htk_settings_t loaded;
+    if(loading.profiles_ready && profiles_find(PROFILES_GLOBAL_KEY, &loaded)) {
+        machine_apply(&loaded);
     } else {
-        indent(f);
-        fprintf(f, "\"%s\": {\n", name);
+        machine_apply(&defaults);
     }
-    level += 1;
 }
 
-static void end_obj(FILE *f, bool last) {
-    ASSERT(level > 0);
-    level -= 1;
-    indent(f);
-    if(!last) {
-        fprintf(f, "},\n");
+static void use_plane(const htk_settings_t *settings) {
+    logMsg("using aircraft profile %016" PRIx64, reload.plane_key);
+    settings_apply(settings);
+    reload.active = SOURCE_PLANE;
+    htk_settings_did_update();
+}
+
+static void store_load(void *refcon) {
+    store_job_t *job = refcon;
+    job->is_stale = profiles_load(settings_parse);
+}
+
+static void store_did_load(void *refcon) {
+    store_job_t *job = refcon;
+    loading.profiles_ready = true;
+
+    bool is_stale = job->is_stale;
+    for(int i = 0; i < SOURCE_COUNT; ++i) {
+        if(!loading.has_early[i]) continue;
+        profiles_put(loading.early_key[i], &loading.early[i], true);
+        loading.has_early[i] = false;
+        is_stale = true;
+    }
+    if(is_stale) snapshot_save();
+    job_free(job);
+
+    use_machine();
+    if(reload.active == SOURCE_GLOBAL) {
+        use_global();
     } else {
-        fprintf(f, "}\n");
+        htk_settings_did_update();
     }
+    if(loading.plane_pending) settings_load_plane();
 }
 
-static void json_bool(FILE *f, const char *key, bool val, bool last) {
-    indent(f);
-    fprintf(f, "\"%s\": %s%s\n", key, val ? "true" : "false", last ? "" : ",");
+void settings_load_profiles() {
+    profiles_init(xpath_plugin(), xpath_system());
+    loading.profiles_ready = false;
+    loading.plane_pending = false;
+    loading.has_early[SOURCE_GLOBAL] = loading.has_early[SOURCE_PLANE] = false;
+    worker_submit(store_load, store_did_load, job_alloc());
 }
 
-static void json_float(FILE *f, const char *key, float val, bool last) {
-    indent(f);
-    fprintf(f, "\"%s\": %f%s\n", key, val, last ? "" : ",");
+void settings_load_global() {
+    char *path = profiles_path(PROFILES_GLOBAL_KEY);
+    watch_source(SOURCE_GLOBAL, path);
+    free(path);
+    use_machine();
+    use_global();
 }
 
-bool settings_save(bool global) {
-    char *path = global
-        ? mkpathname(xpath_plugin(), "config.json", NULL)
-        : mkpathname(xpath_aircraft(), "htrack.json", NULL);
+// Runs on the worker thread.
+static void legacy_read(void *refcon) {
+    legacy_job_t *job = refcon;
+    job->found = file_exists(job->path, NULL) && settings_parse(job->path, &job->settings);
+}
 
-    logMsg("saving settings to `%s`", path);
-    
-    FILE *out = fopen(path, "wb");
-    if(!out) {
-        logMsg("cannot write configuration file");
-        free(path);
-        return false;
+static void legacy_did_read(void *refcon) {
+    legacy_job_t *job = refcon;
+    if(job->generation == loading.generation) {
+        if(job->found) {
+            profiles_put(job->key, &job->settings, false);
+            use_plane(&job->settings);
+        } else {
+            logMsg("no plane-specific settings found");
+        }
     }
-    
-    level = 0;
+    free(job->path);
+    job_free(job);
+}
+
+// Aircraft profiles live in the plugin's store, which is all in memory. An htrack.json in the
+// aircraft folder is still honoured when there isn't a profile yet: it's read on the worker while
+// the global settings stand in, and then copied into the store so it isn't read again.
+void settings_load_plane() {
+    loading.generation += 1;
+    reload.plane_key = profiles_key(xpath_aircraft_file());
+    char *store_path = profiles_path(reload.plane_key);
+    watch_source(SOURCE_PLANE, store_path);
+    free(store_path);
+
+    if(!loading.profiles_ready) {
+        loading.plane_pending = true;
+        return;
+    }
+    loading.plane_pending = false;
+
+    htk_settings_t loaded;
+    if(profiles_find(reload.plane_key, &loaded)) {
+        use_plane(&loaded);
+        return;
+    }
+
+    if(reload.active != SOURCE_GLOBAL) use_global();
+    legacy_job_t *job = job_alloc();
+    job->generation = loading.generation;
+    job->key = reload.plane_key;
+    job->path = mkpathname(xpath_aircraft(), "htrack.json", NULL);
+    worker_submit(legacy_read, legacy_did_read, job);
+}
+
+static struct {
+    htk_save_state_t state;
+    int pending;
+    char message[512];
+} save_status;
+
+static void buf_printf(json_buf_t *buf, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    ASSERT(len >= 0);
+
+    if(buf->size + len + 1 > buf->capacity) {
+        while(buf->size + len + 1 > buf->capacity) {
+            buf->capacity = buf->capacity ? buf->capacity * 2 : 512;
+        }
+        buf->data = safe_realloc(buf->data, buf->capacity);
+    }
+
+    va_start(args, fmt);
+    vsnprintf(buf->data + buf->size, buf->capacity - buf->size, fmt, args);
+    va_end(args);
+    buf->size += len;
+}
+
+static void indent(json_buf_t *buf) {
+    for(int i = 0; i < buf->level; ++i) {
+        buf_printf(buf, "  ");
+    }
+}
+
+static void start_obj(json_buf_t *buf, const char *name) {
+    indent(buf);
+    if(!name) {
+        buf_printf(buf, "{\n");
+    } else {
+        buf_printf(buf, "\"%s\": {\n", name);
+    }
+    buf->level += 1;
+}
+
+static void end_obj(json_buf_t *buf, bool last) {
+    ASSERT(buf->level > 0);
+    buf->level -= 1;
+    indent(buf);
+    buf_printf(buf, last ? "}\n" : "},\n");
+}
+
+static void json_bool(json_buf_t *buf, const char *key, bool val, bool last) {
+    indent(buf);
+    buf_printf(buf, "\"%s\": %s%s\n", key, val ? "true" : "false", last ? "" : ",");
+}
+
+static void json_string(json_buf_t *buf, const char *key, const char *val, bool last) {
+    indent(buf);
+    buf_printf(buf, "\"%s\": \"", key);
+    for(const char *c = val; *c; ++c) {
+        if(*c == '"' || *c == '\\') {
+            buf_printf(buf, "\\%c", *c);
+        } else if((unsigned char)*c >= 0x20) {
+            buf_printf(buf, "%c", *c);
+        }
+    }
+    buf_printf(buf, "\"%s\n", last ? "" : ",");
+}
+
+static void json_int(json_buf_t *buf, const char *key, int val, bool last) {
+    indent(buf);
+    buf_printf(buf, "\"%s\": %d%s\n", key, val, last ? "" : ",");
+}
+
+static void json_float(json_buf_t *buf, const char *key, float val, bool last) {
+    indent(buf);
+    buf_printf(buf, "\"%s\": %f%s\n", key, val, last ? "" : ",");
+}
+
+static void serialize_settings(json_buf_t *out, const htk_settings_t *settings, const char *aircraft) {
+    out->level = 0;
     start_obj(out, NULL);
+    // Not read back, but profile file names are hashes: this tells humans which is which.
+    if(aircraft) json_string(out, "aircraft", aircraft, false);
     start_obj(out, "axes");
-    
+
     for(int i = 0; i < 6; ++i) {
-        json_float(out, axes_sensitivity_name[i], htk_settings.axes_sens[i], false);
-        json_bool(out, axes_reverse_name[i], htk_settings.axes_invert[i], i == 5);
+        json_float(out, axes_sensitivity_name[i], settings->axes_sens[i], false);
+        json_bool(out, axes_reverse_name[i], settings->axes_invert[i], i == 5);
     }
     end_obj(out, false);
     start_obj(out, "smoothing");
-    json_float(out, "input_smoothing", htk_settings.input_smooth, false);
-    json_float(out, "exp_rotation", htk_settings.rotation_smooth, false);
-    json_float(out, "exp_translation", htk_settings.translation_smooth, true);
-    end_obj(out, true);
+    json_float(out, "input_smoothing", settings->input_smooth, false);
+    json_float(out, "exp_rotation", settings->rotation_smooth, false);
+    json_float(out, "exp_translation", settings->translation_smooth, true);
+    end_obj(out, false);
+    start_obj(out, "interface");
+    json_float(out, "refresh_rate", settings->ui_refresh_rate, false);
+    json_bool(out, "legacy_renderer", settings->ui_legacy_renderer, true);
+    end_obj(out, aircraft != NULL);
+    // Aircraft profiles don't get a say in how this computer receives poses.
+    if(!aircraft) {
+        start_obj(out, "input");
+        json_bool(out, "shared_memory", settings->input_local, false);
+        json_bool(out, "realtime", settings->rx_realtime, false);
+        json_int(out, "cpu", settings->rx_cpu, true);
+        end_obj(out, true);
+    }
     end_obj(out, true);
-    
-    fclose(out);
-    free(path);
-    logMsg("settings saved");
+}
+
+static bool replace_file(const char *from, const char *to) {
+#if IBM
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+// Runs on the worker thread: no XPLM calls, no htk_settings access.
+static void save_write(void *refcon) {
+    save_job_t *job = refcon;
+    char *tmp_path = sprintf_alloc("%s.tmp", job->path);
+    job->ok = false;
+    if(job->dir) create_directory_recursive(job->dir);
+
+    FILE *out = fopen(tmp_path, "wb");
+    if(!out) {
+        snprintf(job->error, sizeof(job->error), "cannot open `%s`: %s", tmp_path, strerror(errno));
+        free(tmp_path);
+        return;
+    }
+
+    bool written = fwrite(job->json.data, 1, job->json.size, out) == job->json.size;
+    written = fflush(out) == 0 && written;
+#if IBM
+    written = _commit(_fileno(out)) == 0 && written;
+#else
+    written = fsync(fileno(out)) == 0 && written;
+#endif
+    written = fclose(out) == 0 && written;
+
+    // The rename keeps the file's stamp, and the watcher can see it the moment it lands, so the
+    // stamp is recorded beforehand.
+    file_stamp_t stamp = {.exists = false};
+    if(written && job->source >= 0) {
+        stamp_read(tmp_path, &stamp);
+        mutex_enter(&reload.mtx);
+        reload.written[job->source] = stamp;
+        mutex_exit(&reload.mtx);
+    }
+
+    if(!written) {
+        snprintf(job->error, sizeof(job->error), "cannot write `%s`: %s", tmp_path, strerror(errno));
+        remove(tmp_path);
+    } else if(!replace_file(tmp_path, job->path)) {
+        snprintf(job->error, sizeof(job->error), "cannot replace `%s`", job->path);
+        remove(tmp_path);
+    } else {
+        job->ok = true;
+    }
+
+    if(stamp.exists && !job->ok) {
+        mutex_enter(&reload.mtx);
+        memset(&reload.written[job->source], 0, sizeof(file_stamp_t));
+        mutex_exit(&reload.mtx);
+    }
+    free(tmp_path);
+}
+
+static void free_job(save_job_t *job) {
+    buf_give_back(&job->json);
+    free(job->path);
+    free(job->dir);
+    job_free(job);
+}
+
+// Runs on the sim thread once the worker is done with the job.
+static void save_done(void *refcon) {
+    save_job_t *job = refcon;
+    save_status.pending -= 1;
+
+    if(job->ok) {
+        logMsg("settings saved to `%s`", job->path);
+        snprintf(save_status.message, sizeof(save_status.message), "Settings saved to %s", job->path);
+        if(!save_status.pending) save_status.state = HTK_SAVE_DONE;
+    } else {
+        logMsg("cannot save settings: %s", job->error);
+        snprintf(save_status.message, sizeof(save_status.message), "Save failed: %s", job->error);
+        save_status.state = HTK_SAVE_FAILED;
+    }
+    free_job(job);
+}
+
+// Runs on the worker thread, after every JSON save queued before it.
+static void snapshot_write(void *refcon) {
+    save_job_t *job = refcon;
+    profiles_snapshot_stamp(job->json.data, job->json.size);
+    save_write(job);
+}
+
+static void snapshot_done(void *refcon) {
+    save_job_t *job = refcon;
+    if(!job->ok) logMsg("cannot write profile snapshot: %s", job->error);
+    free_job(job);
+}
+
+// The worker runs jobs in order, so this always lands after any JSON save queued before it, and
+// the snapshot records its sources as they were written.
+static void snapshot_save() {
+    save_job_t *job = job_alloc();
+    job->source = -1;
+    job->path = profiles_snapshot_path();
+    job->json.data = profiles_snapshot(&job->json.size);
+    job->json.capacity = job->json.size;
+    worker_submit(snapshot_write, snapshot_done, job);
+}
+
+bool settings_save(bool global) {
+    save_job_t *job = job_alloc();
+    job->json = buf_take();
+    uint64_t key = PROFILES_GLOBAL_KEY;
+    settings_source_t source = global ? SOURCE_GLOBAL : SOURCE_PLANE;
+    job->source = source;
+    if(global) {
+        serialize_settings(&job->json, &htk_settings, NULL);
+    } else {
+        key = reload.plane_key = profiles_key(xpath_aircraft_file());
+        job->dir = profiles_dir();
+        serialize_settings(&job->json, &htk_settings, xpath_aircraft_file());
+    }
+    job->path = profiles_path(key);
+
+    logMsg("saving settings to `%s`", job->path);
+
+    save_status.pending += 1;
+    save_status.state = HTK_SAVE_PENDING;
+    worker_submit(save_write, save_done, job);
+    // The watcher skips files we wrote ourselves, so the store has to be updated from here. The
+    // worker loads the store first, so until then the save waits for store_did_load().
+    if(loading.profiles_ready) {
+        profiles_put(key, &htk_settings, true);
+        snapshot_save();
+    } else {
+        loading.has_early[source] = true;
+        loading.early_key[source] = key;
+        loading.early[source] = htk_settings;
+    }
     return true;
 }
+
+htk_save_state_t settings_save_state(const char **message) {
+    if(message) *message = save_status.message;
+    return save_status.state;
+}
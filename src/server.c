@@ -12,6 +12,7 @@
 #include <windows.h>
 #else
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <arpa/inet.h>
@@ -19,11 +20,18 @@
 
 #include "server.h"
 #include "htrack.h"
-#include "math.h"
+#include "history.h"
+#include "filter.h"
+#include "forward.h"
+#include "health.h"
+#include "input.h"
+#include "priority.h"
 #include <acfutils/log.h>
 #include <acfutils/helpers.h>
 #include <acfutils/assert.h>
 #include <acfutils/thread.h>
+#include <acfutils/time.h>
+#include <ccore/log.h>
 
 #include <sys/types.h>
 
@@ -33,38 +41,100 @@
 #include <pthread.h>
 #include <errno.h>
 
+#define RATE_PERIOD_USEC (1000000)
+#define RECV_TIMEOUT_MSEC (250)
+#define SERVER_PORT (4242)
+
 static bool server_is_running;
 static thread_t server_thread;
 static int server_socket;
 
 
-static void udp_track_server(void * data) {
-    UNUSED(data);
+void receiver_init(receiver_t *rx, double *input) {
+    priority_apply();
+    rx->input = input;
+    rx->rate_start = microclock();
+    rx->packets = 0;
+    filter_reset();
+    health_reset();
+}
+
+void receiver_tick(receiver_t *rx, uint64_t now) {
+    if(now - rx->rate_start < RATE_PERIOD_USEC) return;
+    ccmsg_t msg = {.kind = HTK_EVENT_INPUT_RATE};
+    msg.f32 = rx->packets * 1e6f / (now - rx->rate_start);
+    htk_post(msg);
+    rx->rate_start = now;
+    rx->packets = 0;
+}
+
+void receiver_push(receiver_t *rx, uint64_t now, const double pose[6]) {
+    rx->packets += 1;
+    health_record(now);
+    filter_update(now, pose, rx->input);
+    forward_push(rx->input);
+    input_push(now, pose, rx->input);
+    history_push(HTK_HISTORY_INPUT, now, rx->input);
+}
+
+// Reads one packet into [data]. Where the kernel timestamps packets, [delay] is set to how long
+// the packet waited for us (microseconds); otherwise, and if the clock stepped, it's -1.
+static ssize_t receive(double data[6], int64_t *delay) {
+    *delay = -1;
+#ifdef SO_TIMESTAMP
+    char control[CMSG_SPACE(sizeof(struct timeval))];
+    struct iovec iov = {.iov_base = data, .iov_len = 6 * sizeof(double)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t bytes = recvmsg(server_socket, &msg, 0);
+    if(bytes < 0) return bytes;
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    for(struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if(c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_TIMESTAMP) continue;
+        struct timeval arrived;
+        memcpy(&arrived, CMSG_DATA(c), sizeof(arrived));
+        int64_t usec = (int64_t)(now.tv_sec - arrived.tv_sec) * 1000000 + (now.tv_usec - arrived.tv_usec);
+        if(usec >= 0) *delay = usec;
+    }
+    return bytes;
+#else
+    return recvfrom(server_socket, (void*)data, 6 * sizeof(double), 0, NULL, NULL);
+#endif
+}
 
+static void udp_track_server(void * data) {
     thread_set_name("headtrack server");
-    logMsg("Head tracking server now listening on 0.0.0.0:4242");
-    server_is_running = true;
+    CCINFO("Head tracking server now listening on 0.0.0.0:4242");
 
-    double *head_in = data;
+    receiver_t rx;
+    receiver_init(&rx, data);
     double udp_data[6];
     while(server_is_running) {
-        ssize_t bytes = recvfrom(server_socket, (void*)udp_data, sizeof(udp_data), 0, NULL, NULL);
+        int64_t delay = -1;
+        ssize_t bytes = receive(udp_data, &delay);
+        if(!server_is_running) break; // woken up by server_stop()
+
+        uint64_t now = microclock();
+        receiver_tick(&rx, now);
+
         if(bytes < 0) {
             if(errno != EAGAIN && errno != EWOULDBLOCK) {
-                logMsg("server: %s", strerror(errno));
+                CCERROR("cannot receive tracker data: %s", strerror(errno));
             }
             continue;
         }
-        for(int i = 0; i < 6; ++i) {
-            head_in[i] = lerp(
-                head_in[i],
-                udp_data[i],
-                1.0 - 0.99 * htk_settings.input_smooth
-            );
-        }
+        receiver_push(&rx, now, udp_data);
+        if(delay >= 0) health_record_delay(delay);
     }
 
-    logMsg("shutting down head tracking server");
+    CCINFO("shutting down head tracking server");
     close(server_socket);
 }
 
@@ -77,14 +147,25 @@ bool server_start(double *input) {
 
     server_socket = socket(PF_INET, SOCK_DGRAM, 0);
 
+    // Only a fallback: server_stop() wakes the thread up itself. Winsock takes milliseconds, and
+    // would read a timeval as no timeout at all.
+#ifdef WIN32
+    DWORD timeout = RECV_TIMEOUT_MSEC;
+#else
     struct timeval timeout;
     timeout.tv_sec = 0;
-    timeout.tv_usec = 250000;
+    timeout.tv_usec = RECV_TIMEOUT_MSEC * 1000;
+#endif
 
     setsockopt(server_socket, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(timeout));
+#ifdef SO_TIMESTAMP
+    // Lets us measure how long packets wait before the server thread gets to run.
+    int enable = 1;
+    setsockopt(server_socket, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable));
+#endif
 
     server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(4242);
+    server_addr.sin_port = htons(SERVER_PORT);
     server_addr.sin_addr.s_addr = inet_addr("0.0.0.0");
     memset(server_addr.sin_zero, 0, sizeof(server_addr.sin_zero));
 
@@ -92,18 +173,36 @@ bool server_start(double *input) {
     if(bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr))) {
         htk_settings.last_error = strerror(errno);
         logMsg("unable to start server: %s", htk_settings.last_error);
+        close(server_socket);
         return false;
     } else {
+        // Set before the thread exists, so a server_stop() right after this still joins it.
+        server_is_running = true;
         thread_create(&server_thread, udp_track_server, input);
         return true;
     }
 }
 
+// An empty datagram gets the server thread out of recv() straight away, instead of leaving the
+// sim thread waiting for the receive timeout.
+static void wake_server() {
+    int sock = socket(PF_INET, SOCK_DGRAM, 0);
+    if(sock < 0) return;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(SERVER_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sendto(sock, "", 0, 0, (struct sockaddr *)&addr, sizeof(addr));
+    close(sock);
+}
+
 void server_stop() {
     if(!server_is_running) return;
     server_is_running = false;
+    wake_server();
     thread_join(&server_thread);
-
 }
 
 bool server_restart(double *input) {
@@ -8,11 +8,29 @@
 //===--------------------------------------------------------------------------------------------===
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/// Bookkeeping for the thread reading the tracker, whichever channel it listens on.
+typedef struct {
+    double *input;
+    uint64_t rate_start;
+    uint32_t packets;
+} receiver_t;
+
+void receiver_init(receiver_t *rx, double *input);
+
+/// Reports the packet rate to the sim thread about once a second. Call on every wake-up, whether
+/// or not a packet came in.
+void receiver_tick(receiver_t *rx, uint64_t now);
+
+/// Smooths a [pose] received at [now] (microseconds) into the receiver's input, and hands it on
+/// to the sim thread.
+void receiver_push(receiver_t *rx, uint64_t now, const double pose[6]);
+
 bool server_start(double *input);
 void server_stop();
 bool server_restart(double *input);
@@ -7,15 +7,21 @@
 // =^•.•^=
 //===--------------------------------------------------------------------------------------------===
 #include "htrack.h"
+#include "filter.h"
+#include "forward.h"
+#include "health.h"
+#include "history.h"
+#include "priority.h"
 #include <ImgWindow/ImgWindow.h>
-#include <algorithm>
+#include <acfutils/time.h>
 #include <tgmath.h>
+#include <thread>
+#include <vector>
 
 static const double limits_out[6] = {100, 100, 100, 135, 90, 90};
 
 class SettingsWindow : public ImgWindow {
 public:
-    static constexpr int num_hist = 50;
     SettingsWindow(int left, int top, int right, int bottom)
         : ImgWindow(left, top, right, bottom) {
         ImGuiIO& io = ImGui::GetIO();
@@ -23,38 +29,149 @@ public:
 
         SetWindowTitle("HeadTrack Settings");
         SetWindowResizingLimits(400, 400, 400, 800);
-
-        std::fill(std::begin(head_hist), std::end(head_hist), 0.f);
-        std::fill(std::begin(sim_hist), std::end(sim_hist), 0.f);
     }
 
     virtual ~SettingsWindow() {
     }
 
-    void updateHistory() {
-        static size_t offset = 6 * (num_hist - 1);
+    static void drawDelays(const char *label, const htk_health_t &health) {
+        ImGui::Text("%s: %.0f us on average, 99%% under %llu us, worst %llu us", label,
+                    health.delays ? (double)health.delay_total / health.delays : 0.0,
+                    (unsigned long long)health_delay_percentile(&health, 0.99),
+                    (unsigned long long)health.delay_max);
+    }
 
-        memmove(head_hist, head_hist+6, (offset * sizeof(float)));
-        memmove(sim_hist, sim_hist+6, (offset * sizeof(float)));
+    // Packet timing from the server thread: enough to tell a slow or bursty tracker (Wi-Fi) from
+    // a problem on the sim side. Returns true if the receive thread settings were changed.
+    bool drawHealth(const ImVec4 &caption_color) {
+        htk_health_t health;
+        health_read(&health);
+
+        double seconds = health.elapsed * 1e-6;
+        ImGui::Text("%llu packets, %.1f packets/s on average",
+                    (unsigned long long)health.packets,
+                    health.packets > 1 && seconds > 0 ? (health.packets - 1) / seconds : 0.0);
+        ImGui::Text("Longest gap: %.0f ms, bursts: %llu",
+                    health.longest_gap * 1e-3,
+                    (unsigned long long)health.bursts);
+
+        uint64_t total = 0;
+        for(int i = 0; i < HTK_HEALTH_BUCKETS; ++i) total += health.buckets[i];
+        float fractions[HTK_HEALTH_BUCKETS];
+        for(int i = 0; i < HTK_HEALTH_BUCKETS; ++i) {
+            fractions[i] = total ? (float)health.buckets[i] / total : 0.f;
+        }
+        ImGui::PlotHistogram("##gaps", fractions, HTK_HEALTH_BUCKETS, 0, nullptr, 0.f, 1.f, ImVec2(0, 40));
+        ImGui::PushStyleColor(ImGuiCol_Text, caption_color);
+        ImGui::TextWrapped("Time between packets, from under %.0f ms to over %.0f ms, doubling each bar.",
+                           health_bucket_limit(0), health_bucket_limit(HTK_HEALTH_BUCKETS - 2));
+        ImGui::PopStyleColor();
 
-        float *head = head_hist + offset;
-        float *sim = sim_hist + offset;
-        for(int i = 0; i < 6; ++i) {
-            head[i] = htk_settings.head[i];
-            sim[i] = htk_settings.sim[i];
+        if(health.delays) {
+            drawDelays("Wake-up delay", health);
+        }
+        htk_health_t baseline;
+        if(health_read_baseline(&baseline)) {
+            drawDelays("Before the change", baseline);
+        }
+
+        if(ImGui::Button("Reset Statistics")) {
+            health_reset();
+        }
+
+        bool changed = false;
+        ImGui::Dummy(ImVec2(0, 10.f));
+        ImGui::Text("Receive Thread");
+        changed |= ImGui::Checkbox("Real-time priority", &htk_settings.rx_realtime);
+        // Every change restarts the receive thread, so the CPU is only applied once the slider
+        // is let go of, not on every frame of a drag.
+        int cpus = (int)std::thread::hardware_concurrency();
+        if(!rx_cpu_active) rx_cpu_edit = htk_settings.rx_cpu;
+        ImGui::SliderInt("##rx_cpu", &rx_cpu_edit, -1, cpus > 0 ? cpus - 1 : 63,
+                         rx_cpu_edit < 0 ? "Any CPU" : "CPU %d");
+        rx_cpu_active = ImGui::IsItemActive();
+        if(ImGui::IsItemDeactivatedAfterEdit()) {
+            htk_settings.rx_cpu = rx_cpu_edit;
+            changed = true;
+        }
+
+        htk_priority_t priority = priority_status();
+        if(priority.error) {
+            ImGui::TextWrapped("Not applied: %s", priority.error);
+        } else if(priority.is_realtime || priority.is_pinned) {
+            ImGui::Text("Applied%s%s", priority.is_realtime ? ", real-time" : "",
+                        priority.is_pinned ? ", pinned" : "");
+        }
+        ImGui::PushStyleColor(ImGuiCol_Text, caption_color);
+        ImGui::TextWrapped("On a busy computer, these can shorten how long packets wait for HeadTrack. Real-time priority usually needs extra permissions (an rtprio limit on Linux). Statistics from before a change are kept to compare against. Saved with the global settings only, as they depend on this computer rather than the aircraft.");
+        ImGui::PopStyleColor();
+        ImGui::Dummy(ImVec2(0, 10.f));
+        return changed;
+    }
+
+    // Draws a min/max scope of one axis. Every screen column shows the range covered by the
+    // samples that fall in it, so jitter shows up as thickness rather than aliasing.
+    void drawScope(const char *label, htk_history_id_t id, int axis, float limit, ImVec2 size) {
+        ImGui::InvisibleButton(label, size);
+        ImVec2 p0 = ImGui::GetItemRectMin();
+        ImVec2 p1 = ImGui::GetItemRectMax();
+        ImDrawList *draw = ImGui::GetWindowDrawList();
+
+        draw->AddRectFilled(p0, p1, ImGui::GetColorU32(ImGuiCol_FrameBg));
+        float mid = 0.5f * (p0.y + p1.y);
+        draw->AddLine(ImVec2(p0.x, mid), ImVec2(p1.x, mid), ImGui::GetColorU32(ImGuiCol_Border));
+
+        int columns = (int)(p1.x - p0.x);
+        if(columns <= 0) return;
+        scope_min.resize(columns);
+        scope_max.resize(columns);
+
+        uint64_t span = (uint64_t)scope_seconds * 1000000;
+        uint64_t t1 = scope_time;
+        uint64_t t0 = t1 > span ? t1 - span : 0;
+        history_decimate(id, axis, t0, t1, columns, scope_min.data(), scope_max.data());
+
+        float scale = 0.5f * (p1.y - p0.y) / limit;
+        ImU32 color = ImGui::GetColorU32(ImGuiCol_PlotLines);
+        bool has_prev = false;
+        float prev_min = 0, prev_max = 0;
+
+        for(int c = 0; c < columns; ++c) {
+            if(std::isnan(scope_min[c])) {
+                has_prev = false;
+                continue;
+            }
+            float lo = scope_min[c], hi = scope_max[c];
+            // Join up with the previous column so steady motion reads as a continuous trace.
+            if(has_prev) {
+                if(lo > prev_max) lo = prev_max;
+                if(hi < prev_min) hi = prev_min;
+            }
+            prev_min = scope_min[c];
+            prev_max = scope_max[c];
+            has_prev = true;
+
+            float y_hi = mid - std::fmin(std::fmax(hi, -limit), limit) * scale;
+            float y_lo = mid - std::fmin(std::fmax(lo, -limit), limit) * scale;
+            draw->AddRectFilled(ImVec2(p0.x + c, y_hi), ImVec2(p0.x + c + 1, y_lo + 1), color);
         }
+
+        draw->AddText(ImVec2(p0.x + 2, p0.y), ImGui::GetColorU32(ImGuiCol_Text), label);
     }
 
     virtual void buildInterface() override {
         float w = ImGui::GetWindowWidth();
         // float win_height = ImGui::GetWindowHeight();
-        updateHistory();
+        if(!scope_paused) scope_time = microclock();
+        SetRefreshRate(htk_settings.ui_refresh_rate);
+        SetRenderer(htk_settings.ui_legacy_renderer ? Renderer::Legacy : Renderer::Buffered);
 
         ImVec4 nice_pink = ImColor(255, 150, 200);
         ImVec4 light_grey = ImColor(0xffb4a0aa);
         ImVec4 yellow = ImColor(247, 170, 61);
         ImVec4 red = ImColor(0xff, 0x33, 0x33);
 
+        bool changed = false;
         float sensitivity[6];
 
         for(int i = 0; i < 6; ++i) {
@@ -74,8 +191,22 @@ public:
             ImGui::PushStyleColor(ImGuiCol_Text, red);
             ImGui::TextWrapped("error: %s", htk_settings.last_error);
             ImGui::PopStyleColor();
+        } else if(htk_settings.input_local) {
+            ImGui::Text("Reading tracker from shared memory (%.0f packets/s)", htk_settings.input_rate);
         } else {
-            ImGui::Text("Server is listening on 0.0.0.0:4242");
+            ImGui::Text("Server is listening on 0.0.0.0:4242 (%.0f packets/s)", htk_settings.input_rate);
+        }
+        for(size_t i = 0; i < forward_count(); ++i) {
+            ImGui::Text("Forwarding to %s", forward_destination(i));
+        }
+        changed |= ImGui::Checkbox("Shared memory input", &htk_settings.input_local);
+        ImGui::PushStyleColor(ImGuiCol_Text, light_grey);
+        ImGui::TextWrapped("For trackers running on this computer that support it, instead of UDP. Saved with the global settings only.");
+        ImGui::PopStyleColor();
+        if(ImGui::Button("Recenter Head Tracking")) {
+            ccmsg_t msg = {};
+            msg.kind = HTK_EVENT_RECENTER;
+            htk_post(msg);
         }
         ImGui::Separator();
 
@@ -86,49 +217,71 @@ public:
         if(ImGui::Button("Save Settings (Aircraft)")) {
             settings_save(false);
         }
+        const char *save_message = nullptr;
+        switch(settings_save_state(&save_message)) {
+        case HTK_SAVE_IDLE:
+            break;
+        case HTK_SAVE_PENDING:
+            ImGui::TextColored(light_grey, "Saving...");
+            break;
+        case HTK_SAVE_DONE:
+            ImGui::PushStyleColor(ImGuiCol_Text, light_grey);
+            ImGui::TextWrapped("%s", save_message);
+            ImGui::PopStyleColor();
+            break;
+        case HTK_SAVE_FAILED:
+            ImGui::PushStyleColor(ImGuiCol_Text, red);
+            ImGui::TextWrapped("%s", save_message);
+            ImGui::PopStyleColor();
+            break;
+        }
 
         ImGui::Dummy(ImVec2(0, 10.f));
         if(ImGui::CollapsingHeader("Motion Sensitivity")) {
             ImGui::TextColored(nice_pink, "Rotation");
             ImGui::Separator();
             ImGui::Text("yaw");
-            ImGui::SliderFloat("##yaw", &sensitivity[3], 0.1, 5, "%.2fx", 2.f);
-            ImGui::SameLine(); ImGui::Checkbox("Reverse##yaw", &htk_settings.axes_invert[3]);
+            changed |= ImGui::SliderFloat("##yaw", &sensitivity[3], 0.1, 5, "%.2fx", 2.f);
+            ImGui::SameLine(); changed |= ImGui::Checkbox("Reverse##yaw", &htk_settings.axes_invert[3]);
 
             ImGui::Text("pitch");
-            ImGui::SliderFloat("##pitch", &sensitivity[4], 0.1, 5, "%.2fx", 2.f);
-            ImGui::SameLine(); ImGui::Checkbox("Reverse##pitch", &htk_settings.axes_invert[4]);
+            changed |= ImGui::SliderFloat("##pitch", &sensitivity[4], 0.1, 5, "%.2fx", 2.f);
+            ImGui::SameLine(); changed |= ImGui::Checkbox("Reverse##pitch", &htk_settings.axes_invert[4]);
 
             ImGui::Text("roll");
-            ImGui::SliderFloat("##roll", &sensitivity[5], 0.1, 5, "%.2fx", 2.f);
-            ImGui::SameLine(); ImGui::Checkbox("Reverse##roll", &htk_settings.axes_invert[5]);
+            changed |= ImGui::SliderFloat("##roll", &sensitivity[5], 0.1, 5, "%.2fx", 2.f);
+            ImGui::SameLine(); changed |= ImGui::Checkbox("Reverse##roll", &htk_settings.axes_invert[5]);
 
             ImGui::Dummy(ImVec2(0, 10.f));
             ImGui::TextColored(nice_pink, "Translation");
             ImGui::Separator();
             ImGui::Text("X Axis");
-            ImGui::SliderFloat("##x", &sensitivity[0], 0.1, 5, "%.2fx", 2.f);
-            ImGui::SameLine(); ImGui::Checkbox("Reverse##x", &htk_settings.axes_invert[0]);
+            changed |= ImGui::SliderFloat("##x", &sensitivity[0], 0.1, 5, "%.2fx", 2.f);
+            ImGui::SameLine(); changed |= ImGui::Checkbox("Reverse##x", &htk_settings.axes_invert[0]);
             ImGui::Text("Y Axis");
-            ImGui::SliderFloat("##y", &sensitivity[1], 0.1, 5, "%.2fx", 2.f);
-            ImGui::SameLine(); ImGui::Checkbox("Reverse##y", &htk_settings.axes_invert[1]);
+            changed |= ImGui::SliderFloat("##y", &sensitivity[1], 0.1, 5, "%.2fx", 2.f);
+            ImGui::SameLine(); changed |= ImGui::Checkbox("Reverse##y", &htk_settings.axes_invert[1]);
             ImGui::Text("Z Axis");
-            ImGui::SliderFloat("##z", &sensitivity[2], 0.1, 5, "%.2fx", 2.f);
-            ImGui::SameLine(); ImGui::Checkbox("Reverse##z", &htk_settings.axes_invert[2]);
+            changed |= ImGui::SliderFloat("##z", &sensitivity[2], 0.1, 5, "%.2fx", 2.f);
+            ImGui::SameLine(); changed |= ImGui::Checkbox("Reverse##z", &htk_settings.axes_invert[2]);
             ImGui::Dummy(ImVec2(0, 10.f));
         }
 
         if(ImGui::CollapsingHeader("Smoothing and Sensitivity")) {
             ImGui::Text("Input Smoothing");
-            ImGui::SliderFloat("##input_smoothing", &htk_settings.input_smooth, 0.f, 1.f, "%.2f");
+            changed |= ImGui::SliderFloat("##input_smoothing", &htk_settings.input_smooth, 0.f, 1.f, "%.2f");
             ImGui::PushStyleColor(ImGuiCol_Text, light_grey);
-            ImGui::TextWrapped("Input smoothing reduces jitter due to tracking, but increases input lag.");
+            ImGui::TextWrapped("Input smoothing adapts to how noisy your tracker is: higher values aim for a steadier view when your head is still. Deliberate movements are let through without lag.");
+            float noise[6];
+            filter_noise(noise);
+            ImGui::Text("Measured noise: %.2f / %.2f / %.2f deg, %.2f / %.2f / %.2f cm",
+                        noise[3], noise[4], noise[5], noise[0], noise[1], noise[2]);
             ImGui::PopStyleColor();
             ImGui::Dummy(ImVec2(0, 10.f));
             ImGui::Text("Rotation Response");
-            ImGui::SliderFloat("##exp_rotation", &htk_settings.rotation_smooth, 0.f, 1.f, "%.2f");
+            changed |= ImGui::SliderFloat("##exp_rotation", &htk_settings.rotation_smooth, 0.f, 1.f, "%.2f");
             ImGui::Text("Translation Response");
-            ImGui::SliderFloat("##exp_translation", &htk_settings.translation_smooth, 0.f, 1.f, "%.2f");
+            changed |= ImGui::SliderFloat("##exp_translation", &htk_settings.translation_smooth, 0.f, 1.f, "%.2f");
             ImGui::PushStyleColor(ImGuiCol_Text, light_grey);
             ImGui::TextWrapped("Higher response values give you finer-grained control around the neutral position, at the expense of coarser movement at large head deflections.");
             ImGui::PopStyleColor();
@@ -136,7 +289,20 @@ public:
             ImGui::Dummy(ImVec2(0, 10.f));
         }
 
+        if(ImGui::CollapsingHeader("Tracker Health")) {
+            changed |= drawHealth(light_grey);
+        }
+
         if(ImGui::CollapsingHeader("Tracking State")) {
+            ImGui::Dummy(ImVec2(0, 10.f));
+            ImGui::SliderInt("##scope_length", &scope_seconds, 1, HTK_HISTORY_SECONDS, "%d s");
+            ImGui::SameLine(); ImGui::Checkbox("Pause", &scope_paused);
+            ImGui::SliderFloat("##refresh_rate", &htk_settings.ui_refresh_rate, 5.f, 60.f, "%.0f Hz");
+            ImGui::PushStyleColor(ImGuiCol_Text, light_grey);
+            ImGui::TextWrapped("Lower refresh rates make the settings window cheaper to leave open.");
+            ImGui::PopStyleColor();
+            ImGui::Checkbox("Use legacy renderer", &htk_settings.ui_legacy_renderer);
+
             ImGui::Dummy(ImVec2(0, 10.f));
             ImGui::TextColored(nice_pink, "Input (Head)");
             ImGui::PushStyleColor(ImGuiCol_PlotLines, yellow);
@@ -146,49 +312,32 @@ public:
                 plot_limits[i] = limits_out[i] / htk_settings.axes_sens[i];
             }
 
-            ImGui::PlotLines("##hyaw", head_hist + 3, num_hist, 0, "Yaw",
-                -plot_limits[3], plot_limits[3],
-                ImVec2(w/3.3, 30), 6 * sizeof(float));
+            ImVec2 plot_size(w/3.3, 30);
+            drawScope("Yaw", HTK_HISTORY_INPUT, 3, plot_limits[3], plot_size);
             ImGui::SameLine();
-            ImGui::PlotLines("##hpitch", head_hist + 4, num_hist, 0, "Pitch",
-                -plot_limits[4], plot_limits[4],
-                ImVec2(w/3.3, 30), 6 * sizeof(float));
+            drawScope("Pitch", HTK_HISTORY_INPUT, 4, plot_limits[4], plot_size);
             ImGui::SameLine();
-            ImGui::PlotLines("##hroll", head_hist + 5, num_hist, 0, "Roll",
-                -plot_limits[5], plot_limits[5],
-                ImVec2(w/3.3, 30), 6 * sizeof(float));
-            ImGui::PlotLines("##hx", head_hist + 0, num_hist, 0, "X",
-                -plot_limits[0], plot_limits[0],
-                ImVec2(w/3.3, 30), 6 * sizeof(float));
+            drawScope("Roll", HTK_HISTORY_INPUT, 5, plot_limits[5], plot_size);
+            drawScope("X", HTK_HISTORY_INPUT, 0, plot_limits[0], plot_size);
             ImGui::SameLine();
-            ImGui::PlotLines("##hy", head_hist + 1, num_hist, 0, "Y",
-                -plot_limits[1], plot_limits[1],
-                ImVec2(w/3.3, 30), 6 * sizeof(float));
+            drawScope("Y", HTK_HISTORY_INPUT, 1, plot_limits[1], plot_size);
             ImGui::SameLine();
-            ImGui::PlotLines("##hz", head_hist + 2, num_hist, 0, "Z",
-                -plot_limits[2], plot_limits[2],
-                ImVec2(w/3.3, 30), 6 * sizeof(float));
+            drawScope("Z", HTK_HISTORY_INPUT, 2, plot_limits[2], plot_size);
 
             ImGui::Dummy(ImVec2(0, 10.f));
             ImGui::TextColored(nice_pink, "Output (Sim)");
-            ImGui::PlotLines("##syaw", sim_hist + 3, num_hist, 0, "Yaw",
-                -135, 135, ImVec2(w/3.3, 30), 6 * sizeof(float));
+            ImGui::PushID("sim");
+            drawScope("Yaw", HTK_HISTORY_OUTPUT, 3, limits_out[3], plot_size);
             ImGui::SameLine();
-            ImGui::PlotLines("##spitch", sim_hist + 4, num_hist, 0, "Pitch",
-                -90, 90, ImVec2(w/3.3, 30), 6 * sizeof(float));
+            drawScope("Pitch", HTK_HISTORY_OUTPUT, 4, limits_out[4], plot_size);
             ImGui::SameLine();
-            ImGui::PlotLines("##sroll", sim_hist + 5, num_hist, 0, "Roll",
-                -90, 90, ImVec2(w/3.3, 30), 6 * sizeof(float));
-
-            ImGui::PlotLines("##sx", sim_hist + 0, num_hist, 0, "X",
-                -100, 100, ImVec2(w/3.3, 30), 6 * sizeof(float));
+            drawScope("Roll", HTK_HISTORY_OUTPUT, 5, limits_out[5], plot_size);
+            drawScope("X", HTK_HISTORY_OUTPUT, 0, limits_out[0], plot_size);
             ImGui::SameLine();
-            ImGui::PlotLines("##sy", sim_hist + 1, num_hist, 0, "Y",
-                -100, 100, ImVec2(w/3.3, 30), 6 * sizeof(float));
+            drawScope("Y", HTK_HISTORY_OUTPUT, 1, limits_out[1], plot_size);
             ImGui::SameLine();
-            ImGui::PlotLines("##sz", sim_hist + 2, num_hist, 0, "Z",
-                -100, 100, ImVec2(w/3.3, 30), 6 * sizeof(float));
-
+            drawScope("Z", HTK_HISTORY_OUTPUT, 2, limits_out[2], plot_size);
+            ImGui::PopID();
             ImGui::Dummy(ImVec2(0, 10.f));
             ImGui::PopStyleColor();
         }
@@ -201,14 +350,20 @@ public:
         ImGui::PopStyleColor();
 
 
-        for(int i = 0; i < 6; ++i)
-            htk_settings.axes_sens[i] = sensitivity[i];
-
-        htk_settings_did_update();
+        if(changed) {
+            for(int i = 0; i < 6; ++i)
+                htk_settings.axes_sens[i] = sensitivity[i];
+            htk_settings_did_update();
+        }
     }
 private:
-    float sim_hist[6 * num_hist];
-    float head_hist[6 * num_hist];
+    int scope_seconds = 10;
+    bool scope_paused = false;
+    uint64_t scope_time = 0;
+    std::vector<float> scope_min;
+    std::vector<float> scope_max;
+    int rx_cpu_edit = -1;
+    bool rx_cpu_active = false;
 };
 
 SettingsWindow* window = nullptr;
@@ -0,0 +1,271 @@
+//===--------------------------------------------------------------------------------------------===
+// watcher.c - background thread that notices when files change on disk
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include "watcher.h"
+#include <acfutils/assert.h>
+#include <acfutils/helpers.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/thread.h>
+#include <acfutils/time.h>
+#include <ccore/log.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if LIN
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#define POLL_USEC (500000)
+#define INOTIFY_TIMEOUT_MSEC (250)
+
+typedef struct {
+    bool exists;
+    int64_t size;
+    int64_t mtime;
+    long mtime_nsec;
+} stamp_t;
+
+typedef struct {
+    char *path;         // NULL when the slot is unused
+    const char *name;   // last path component, points into [path]
+    int wd;             // inotify watch on the parent directory, -1 when polling
+    stamp_t stamp;
+    bool settling;      // stamp changed on the last poll, waiting for it to stop moving
+} watch_t;
+
+static struct {
+    bool is_running;
+    bool must_stop;
+    thread_t thread;
+    mutex_t mtx;
+    condvar_t cv;
+
+    watcher_fn_t callback;
+    void *refcon;
+
+    unsigned generation;
+    watch_t files[WATCHER_MAX_FILES];
+    int inotify_fd;
+} watcher;
+
+static void get_stamp(const char *path, stamp_t *out) {
+    struct stat st;
+    memset(out, 0, sizeof(*out));
+    if(stat(path, &st) != 0) return;
+
+    out->exists = true;
+    out->size = st.st_size;
+    out->mtime = st.st_mtime;
+#if LIN
+    out->mtime_nsec = st.st_mtim.tv_nsec;
+#elif APL
+    out->mtime_nsec = st.st_mtimespec.tv_nsec;
+#endif
+}
+
+static bool same_stamp(const stamp_t *a, const stamp_t *b) {
+    return a->exists == b->exists
+        && a->size == b->size
+        && a->mtime == b->mtime
+        && a->mtime_nsec == b->mtime_nsec;
+}
+
+#if LIN
+// Watch the directory rather than the file itself: most editors, and our own settings_save(),
+// replace the file with a rename, which would leave a watch on the old inode dangling.
+static void inotify_rebuild() {
+    for(int i = 0; i < WATCHER_MAX_FILES; ++i) {
+        watch_t *w = &watcher.files[i];
+        if(w->wd >= 0) inotify_rm_watch(watcher.inotify_fd, w->wd);
+        w->wd = -1;
+    }
+
+    for(int i = 0; i < WATCHER_MAX_FILES; ++i) {
+        watch_t *w = &watcher.files[i];
+        if(!w->path) continue;
+
+        char *dir = safe_strdup(w->path);
+        char *sep = strrchr(dir, DIRSEP);
+        if(sep) *sep = '\0';
+
+        w->wd = inotify_add_watch(watcher.inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+        if(w->wd < 0) {
+            CCWARN("cannot watch `%s` (%s), polling instead", dir, strerror(errno));
+        }
+        free(dir);
+    }
+}
+
+static void inotify_read(bool changed[WATCHER_MAX_FILES]) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for(;;) {
+        ssize_t len = read(watcher.inotify_fd, buf, sizeof(buf));
+        if(len <= 0) break;
+
+        for(char *p = buf; p < buf + len;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+
+            for(int i = 0; i < WATCHER_MAX_FILES; ++i) {
+                const watch_t *w = &watcher.files[i];
+                if(!w->path) continue;
+                if((ev->mask & IN_Q_OVERFLOW) || (ev->wd == w->wd && ev->len && !strcmp(ev->name, w->name))) {
+                    changed[i] = true;
+                }
+            }
+        }
+    }
+}
+#endif
+
+// Files that aren't covered by inotify are polled. A change is only reported once the stamp has
+// been stable for a full poll period, so we don't pick up a file halfway through being written.
+static void poll_stamps(bool changed[WATCHER_MAX_FILES]) {
+    for(int i = 0; i < WATCHER_MAX_FILES; ++i) {
+        watch_t *w = &watcher.files[i];
+        if(!w->path || w->wd >= 0) continue;
+
+        stamp_t stamp;
+        get_stamp(w->path, &stamp);
+        if(!same_stamp(&stamp, &w->stamp)) {
+            w->stamp = stamp;
+            w->settling = true;
+        } else if(w->settling) {
+            w->settling = false;
+            if(stamp.exists) changed[i] = true;
+        }
+    }
+}
+
+static void watcher_main(void *refcon) {
+    UNUSED(refcon);
+    thread_set_name("headtrack watcher");
+    unsigned generation = watcher.generation - 1;
+
+    mutex_enter(&watcher.mtx);
+    while(!watcher.must_stop) {
+        bool changed[WATCHER_MAX_FILES] = {false};
+
+#if LIN
+        if(watcher.inotify_fd >= 0) {
+            if(generation != watcher.generation) inotify_rebuild();
+            generation = watcher.generation;
+
+            struct pollfd pfd = {.fd = watcher.inotify_fd, .events = POLLIN};
+            mutex_exit(&watcher.mtx);
+            int ready = poll(&pfd, 1, INOTIFY_TIMEOUT_MSEC);
+            mutex_enter(&watcher.mtx);
+
+            // The watch list might have been swapped while we were waiting, and the events
+            // would refer to the old one.
+            if(ready > 0 && generation == watcher.generation) inotify_read(changed);
+        } else
+#endif
+        {
+            cv_timedwait(&watcher.cv, &watcher.mtx, microclock() + POLL_USEC);
+        }
+        if(watcher.must_stop) break;
+        poll_stamps(changed);
+
+        for(int i = 0; i < WATCHER_MAX_FILES; ++i) {
+            if(!changed[i] || !watcher.files[i].path) continue;
+
+            char *path = safe_strdup(watcher.files[i].path);
+            mutex_exit(&watcher.mtx);
+            watcher.callback(i, path, watcher.refcon);
+            free(path);
+            mutex_enter(&watcher.mtx);
+        }
+    }
+    mutex_exit(&watcher.mtx);
+}
+
+void watcher_start(watcher_fn_t callback, void *refcon) {
+    ASSERT(callback);
+    if(watcher.is_running) return;
+
+    mutex_init(&watcher.mtx);
+    cv_init(&watcher.cv);
+    watcher.callback = callback;
+    watcher.refcon = refcon;
+    watcher.must_stop = false;
+    watcher.generation = 0;
+    for(int i = 0; i < WATCHER_MAX_FILES; ++i) {
+        memset(&watcher.files[i], 0, sizeof(watch_t));
+        watcher.files[i].wd = -1;
+    }
+
+#if LIN
+    watcher.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watcher.inotify_fd < 0) {
+        logMsg("watcher: inotify unavailable (%s), polling instead", strerror(errno));
+    }
+#else
+    watcher.inotify_fd = -1;
+#endif
+
+    VERIFY(thread_create(&watcher.thread, watcher_main, NULL));
+    watcher.is_running = true;
+}
+
+void watcher_stop() {
+    if(!watcher.is_running) return;
+
+    mutex_enter(&watcher.mtx);
+    watcher.must_stop = true;
+    cv_broadcast(&watcher.cv);
+    mutex_exit(&watcher.mtx);
+
+    thread_join(&watcher.thread);
+    watcher.is_running = false;
+
+#if LIN
+    if(watcher.inotify_fd >= 0) close(watcher.inotify_fd);
+#endif
+    watcher.inotify_fd = -1;
+
+    for(int i = 0; i < WATCHER_MAX_FILES; ++i) {
+        free(watcher.files[i].path);
+        watcher.files[i].path = NULL;
+    }
+    cv_destroy(&watcher.cv);
+    mutex_destroy(&watcher.mtx);
+}
+
+void watcher_set_path(int slot, const char *path) {
+    ASSERT(slot >= 0 && slot < WATCHER_MAX_FILES);
+    if(!watcher.is_running) return;
+
+    mutex_enter(&watcher.mtx);
+    watch_t *w = &watcher.files[slot];
+    if(w->path && path && !strcmp(w->path, path)) {
+        mutex_exit(&watcher.mtx);
+        return;
+    }
+
+    free(w->path);
+    w->path = path ? safe_strdup(path) : NULL;
+    w->settling = false;
+    if(w->path) {
+        const char *sep = strrchr(w->path, DIRSEP);
+        w->name = sep ? sep + 1 : w->path;
+        get_stamp(w->path, &w->stamp);
+    }
+
+    watcher.generation += 1;
+    cv_broadcast(&watcher.cv);
+    mutex_exit(&watcher.mtx);
+}
@@ -0,0 +1,34 @@
+//===--------------------------------------------------------------------------------------------===
+// watcher.h - background thread that notices when files change on disk
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WATCHER_MAX_FILES (4)
+
+/// Called on the watcher thread when the file in [slot] was written, created or replaced.
+typedef void (*watcher_fn_t)(int slot, const char *path, void *refcon);
+
+/// Starts the watcher thread. Uses inotify where available, and polls modification times
+/// otherwise.
+void watcher_start(watcher_fn_t callback, void *refcon);
+
+/// Stops the watcher thread. No callback runs after this returns.
+void watcher_stop();
+
+/// Starts watching [path] in [slot], replacing whatever was watched there. The file does not
+/// need to exist yet. Passing NULL stops watching [slot].
+void watcher_set_path(int slot, const char *path);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
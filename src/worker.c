@@ -0,0 +1,156 @@
+//===--------------------------------------------------------------------------------------------===
+// worker.c - background thread for disk I/O and other slow work
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#include "worker.h"
+#include <acfutils/assert.h>
+#include <acfutils/log.h>
+#include <acfutils/thread.h>
+#include <ccore/alloc.h>
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+typedef struct job_s {
+    struct job_s *next;
+    worker_fn_t fn;
+    worker_fn_t done;
+    void *refcon;
+} job_t;
+
+typedef struct {
+    job_t *head;
+    job_t *tail;
+} queue_t;
+
+// Jobs are submitted and completed on the sim thread, so their records come out of a pool that
+// only that thread touches.
+#define JOB_CHUNK_SIZE (32)
+
+static struct {
+    bool is_running;
+    bool must_stop;
+    thread_t thread;
+    mutex_t mtx;
+    condvar_t cv;
+
+    queue_t pending;
+    queue_t finished;
+    atomic_bool has_finished;
+    ccfixed_t jobs;
+} worker;
+
+static void queue_push(queue_t *q, job_t *job) {
+    job->next = NULL;
+    if(q->tail) {
+        q->tail->next = job;
+    } else {
+        q->head = job;
+    }
+    q->tail = job;
+}
+
+static job_t *queue_pop(queue_t *q) {
+    job_t *job = q->head;
+    if(!job) return NULL;
+    q->head = job->next;
+    if(!q->head) q->tail = NULL;
+    return job;
+}
+
+static void worker_main(void *refcon) {
+    UNUSED(refcon);
+    thread_set_name("headtrack worker");
+
+    mutex_enter(&worker.mtx);
+    for(;;) {
+        job_t *job = queue_pop(&worker.pending);
+        if(!job) {
+            if(worker.must_stop) break;
+            cv_wait(&worker.cv, &worker.mtx);
+            continue;
+        }
+        mutex_exit(&worker.mtx);
+
+        job->fn(job->refcon);
+
+        mutex_enter(&worker.mtx);
+        queue_push(&worker.finished, job);
+        atomic_store(&worker.has_finished, true);
+    }
+    mutex_exit(&worker.mtx);
+}
+
+void worker_start() {
+    if(worker.is_running) return;
+    mutex_init(&worker.mtx);
+    cv_init(&worker.cv);
+    worker.pending.head = worker.pending.tail = NULL;
+    worker.finished.head = worker.finished.tail = NULL;
+    worker.must_stop = false;
+    atomic_store(&worker.has_finished, false);
+    ccfixed_init(&worker.jobs, sizeof(job_t), JOB_CHUNK_SIZE);
+
+    VERIFY(thread_create(&worker.thread, worker_main, NULL));
+    worker.is_running = true;
+}
+
+void worker_stop() {
+    if(!worker.is_running) return;
+
+    mutex_enter(&worker.mtx);
+    worker.must_stop = true;
+    cv_broadcast(&worker.cv);
+    mutex_exit(&worker.mtx);
+
+    thread_join(&worker.thread);
+    worker.is_running = false;
+
+    // Nothing else can touch the queues now, so completions can run without the lock.
+    worker_poll();
+    ccfixed_deinit(&worker.jobs);
+    cv_destroy(&worker.cv);
+    mutex_destroy(&worker.mtx);
+}
+
+void worker_submit(worker_fn_t fn, worker_fn_t done, void *refcon) {
+    ASSERT(fn);
+    // Completions that run during worker_stop() can still queue follow-up work.
+    if(!worker.is_running) {
+        fn(refcon);
+        if(done) done(refcon);
+        return;
+    }
+
+    job_t *job = ccfixed_alloc(&worker.jobs);
+    job->fn = fn;
+    job->done = done;
+    job->refcon = refcon;
+
+    mutex_enter(&worker.mtx);
+    queue_push(&worker.pending, job);
+    cv_signal(&worker.cv);
+    mutex_exit(&worker.mtx);
+}
+
+void worker_poll() {
+    // Cheap early-out: this runs every frame, and completions are rare.
+    if(!atomic_load(&worker.has_finished)) return;
+
+    if(worker.is_running) mutex_enter(&worker.mtx);
+    job_t *list = worker.finished.head;
+    worker.finished.head = worker.finished.tail = NULL;
+    atomic_store(&worker.has_finished, false);
+    if(worker.is_running) mutex_exit(&worker.mtx);
+
+    while(list) {
+        job_t *job = list;
+        list = job->next;
+        if(job->done) job->done(job->refcon);
+        ccfixed_free(&worker.jobs, job);
+    }
+}
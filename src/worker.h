@@ -0,0 +1,34 @@
+//===--------------------------------------------------------------------------------------------===
+// worker.h - background thread for disk I/O and other slow work
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+#pragma once
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*worker_fn_t)(void *refcon);
+
+/// Starts the worker thread.
+void worker_start();
+
+/// Finishes all queued jobs, stops the worker thread and runs outstanding completions.
+void worker_stop();
+
+/// Queues [job] to run on the worker thread. Once it has run, [done] (if not NULL) is called
+/// with the same [refcon] on the sim thread, during the next call to worker_poll().
+/// If the worker isn't running, both are called right away instead.
+void worker_submit(worker_fn_t job, worker_fn_t done, void *refcon);
+
+/// Runs the completion callbacks of finished jobs. Must be called from the sim thread.
+void worker_poll();
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
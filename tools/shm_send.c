@@ -0,0 +1,71 @@
+//===--------------------------------------------------------------------------------------------===
+// shm_send.c - reference writer for HeadTrack's shared-memory input
+//
+// Created by Amy Parent <amy@amyparent.com>
+// Copyright (c) 2020 Amy Parent
+// Licensed under the MIT License
+// =^•.•^=
+//===--------------------------------------------------------------------------------------------===
+// Usage:
+//   htk-shm-send            reads "x y z yaw pitch roll" lines from stdin, one pose per line
+//   htk-shm-send --demo     sweeps the view left and right at 100Hz, to check the plumbing
+#include <htrack/shm.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static htk_shm_input_t *attach(void) {
+    htk_shm_input_t *shm = NULL;
+    bool has_warned = false;
+    while(!(shm = htk_shm_input_open())) {
+        if(!has_warned) {
+            fprintf(stderr, "waiting for HeadTrack (is \"Shared memory input\" turned on?)\n");
+            has_warned = true;
+        }
+        sleep(1);
+    }
+    fprintf(stderr, "attached to %s\n", HTK_SHM_INPUT_NAME);
+    return shm;
+}
+
+static void publish(htk_shm_input_t **shm, const double pose[6]) {
+    if(htk_shm_input_is_closed(*shm)) {
+        fprintf(stderr, "HeadTrack went away\n");
+        htk_shm_input_close(*shm);
+        *shm = attach();
+    }
+    htk_shm_input_write(*shm, pose);
+}
+
+int main(int argc, const char **argv) {
+    bool demo = argc > 1 && !strcmp(argv[1], "--demo");
+    if(argc > 2 || (argc > 1 && !demo)) {
+        fprintf(stderr, "usage: %s [--demo]\n", argv[0]);
+        return 1;
+    }
+
+    htk_shm_input_t *shm = attach();
+    double pose[6] = {0};
+
+    if(demo) {
+        const struct timespec period = {0, 10000000};
+        for(unsigned long frame = 0;; ++frame) {
+            pose[3] = 30.0 * sin(frame * 0.01);
+            pose[4] = 5.0 * sin(frame * 0.023);
+            publish(&shm, pose);
+            nanosleep(&period, NULL);
+        }
+    }
+
+    char line[256];
+    while(fgets(line, sizeof(line), stdin)) {
+        if(sscanf(line, "%lf %lf %lf %lf %lf %lf",
+                  &pose[0], &pose[1], &pose[2], &pose[3], &pose[4], &pose[5]) != 6) {
+            fprintf(stderr, "ignoring malformed line: %s", line);
+            continue;
+        }
+        publish(&shm, pose);
+    }
+    htk_shm_input_close(shm);
+    return 0;
+}